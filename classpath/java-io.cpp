@@ -180,6 +180,53 @@ inline void doWrite(JNIEnv* e, jint fd, const jbyte* data, jint length)
   }
 }
 
+// Byte arrays at least this large are allocated by the VM as fixed
+// objects, so GetPrimitiveArrayCritical gives us a pointer directly
+// into them instead of a copy:
+const jint DirectArraySize = 64 * 1024;
+
+// Smaller arrays are staged through a buffer on the stack:
+const jint StagingBufferSize = 16 * 1024;
+
+int readArray(JNIEnv* e, jint fd, jbyteArray b, jint offset, jint length)
+{
+  if (e->GetArrayLength(b) >= DirectArraySize) {
+    jbyte* data = static_cast<jbyte*>(e->GetPrimitiveArrayCritical(b, 0));
+    int r = doRead(e, fd, data + offset, length);
+    e->ReleasePrimitiveArrayCritical(b, data, 0);
+    return r;
+  } else {
+    // a short read is permitted, so we don't loop here
+    jbyte buffer[StagingBufferSize];
+    int r = doRead(
+        e, fd, buffer, length < StagingBufferSize ? length : StagingBufferSize);
+    if (r > 0) {
+      e->SetByteArrayRegion(b, offset, r, buffer);
+    }
+    return r;
+  }
+}
+
+void writeArray(JNIEnv* e, jint fd, jbyteArray b, jint offset, jint length)
+{
+  if (e->GetArrayLength(b) >= DirectArraySize) {
+    jbyte* data = static_cast<jbyte*>(e->GetPrimitiveArrayCritical(b, 0));
+    doWrite(e, fd, data + offset, length);
+    e->ReleasePrimitiveArrayCritical(b, data, JNI_ABORT);
+  } else {
+    jbyte buffer[StagingBufferSize];
+    while (length > 0 and not e->ExceptionCheck()) {
+      jint n = length < StagingBufferSize ? length : StagingBufferSize;
+      e->GetByteArrayRegion(b, offset, n, buffer);
+      if (not e->ExceptionCheck()) {
+        doWrite(e, fd, buffer, n);
+      }
+      offset += n;
+      length -= n;
+    }
+  }
+}
+
 #ifdef PLATFORM_WINDOWS
 
 class Directory {
@@ -762,19 +809,7 @@ extern "C" JNIEXPORT jint JNICALL
                                               jint offset,
                                               jint length)
 {
-  jbyte* data = static_cast<jbyte*>(malloc(length));
-  if (data == 0) {
-    throwNew(e, "java/lang/OutOfMemoryError", 0);
-    return 0;
-  }
-
-  int r = doRead(e, fd, data, length);
-
-  e->SetByteArrayRegion(b, offset, length, data);
-
-  free(data);
-
-  return r;
+  return readArray(e, fd, b, offset, length);
 }
 
 extern "C" JNIEXPORT void JNICALL
@@ -817,19 +852,7 @@ extern "C" JNIEXPORT void JNICALL
                                                 jint offset,
                                                 jint length)
 {
-  jbyte* data = static_cast<jbyte*>(malloc(length));
-
-  if (data == 0) {
-    throwNew(e, "java/lang/OutOfMemoryError", 0);
-    return;
-  }
-
-  e->GetByteArrayRegion(b, offset, length, data);
-  if (not e->ExceptionCheck()) {
-    doWrite(e, fd, data, length);
-  }
-
-  free(data);
+  writeArray(e, fd, b, offset, length);
 }
 
 extern "C" JNIEXPORT void JNICALL
@@ -910,11 +933,21 @@ extern "C" JNIEXPORT jint JNICALL
     return -1;
   }
 
-  uint8_t* dst
-      = reinterpret_cast<uint8_t*>(e->GetPrimitiveArrayCritical(buffer, 0));
+  int64_t bytesRead;
+  if (e->GetArrayLength(buffer) >= DirectArraySize) {
+    uint8_t* dst
+        = reinterpret_cast<uint8_t*>(e->GetPrimitiveArrayCritical(buffer, 0));
 
-  int64_t bytesRead = ::read(fd, dst + offset, length);
-  e->ReleasePrimitiveArrayCritical(buffer, dst, 0);
+    bytesRead = ::read(fd, dst + offset, length);
+    e->ReleasePrimitiveArrayCritical(buffer, dst, 0);
+  } else {
+    jbyte staging[StagingBufferSize];
+    bytesRead = ::read(
+        fd, staging, length < StagingBufferSize ? length : StagingBufferSize);
+    if (bytesRead > 0) {
+      e->SetByteArrayRegion(buffer, offset, bytesRead, staging);
+    }
+  }
 
   if (bytesRead == -1) {
     throwNewErrno(e, "java/io/IOException");
@@ -960,11 +993,19 @@ extern "C" JNIEXPORT jint JNICALL
     return -1;
   }
 
-  uint8_t* dst
-      = reinterpret_cast<uint8_t*>(e->GetPrimitiveArrayCritical(buffer, 0));
+  int64_t bytesWritten;
+  if (e->GetArrayLength(buffer) >= DirectArraySize) {
+    uint8_t* dst
+        = reinterpret_cast<uint8_t*>(e->GetPrimitiveArrayCritical(buffer, 0));
 
-  int64_t bytesWritten = ::write(fd, dst + offset, length);
-  e->ReleasePrimitiveArrayCritical(buffer, dst, 0);
+    bytesWritten = ::write(fd, dst + offset, length);
+    e->ReleasePrimitiveArrayCritical(buffer, dst, JNI_ABORT);
+  } else {
+    jbyte staging[StagingBufferSize];
+    jint n = length < StagingBufferSize ? length : StagingBufferSize;
+    e->GetByteArrayRegion(buffer, offset, n, staging);
+    bytesWritten = ::write(fd, staging, n);
+  }
 
   if (bytesWritten == -1) {
     throwNewErrno(e, "java/io/IOException");
@@ -64,6 +64,20 @@
 #endif
 #include "sys/utsname.h"
 #include "sys/wait.h"
+#include "poll.h"
+#ifndef __ANDROID__
+#define HAVE_POSIX_SPAWN
+#include "spawn.h"
+#endif
+#ifdef __linux__
+#include "sys/syscall.h"
+#endif
+#ifdef __APPLE__
+#include <crt_externs.h>
+#define environ (*_NSGetEnviron())
+#else
+extern char** environ;
+#endif
 
 #endif  // not PLATFORM_WINDOWS
 
@@ -504,6 +518,12 @@ extern "C" JNIEXPORT void JNICALL
 #endif
 }
 
+extern "C" JNIEXPORT jboolean JNICALL
+    Java_java_lang_Runtime_pidfdSupported(JNIEnv*, jclass)
+{
+  return false;
+}
+
 Locale getLocale()
 {
 #if !defined(WINAPI_FAMILY) || WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)
@@ -690,7 +710,6 @@ extern "C" JNIEXPORT void JNICALL
   int in[] = {-1, -1};
   int out[] = {-1, -1};
   int err[] = {-1, -1};
-  int msg[] = {-1, -1};
 
   makePipe(e, in);
   if (e->ExceptionCheck())
@@ -707,6 +726,44 @@ extern "C" JNIEXPORT void JNICALL
     return;
   jlong errDescriptor = static_cast<jlong>(err[0]);
   e->SetLongArrayRegion(process, 4, 1, &errDescriptor);
+
+  // our ends of the pipes must not leak into this or any other child
+  fcntl(in[0], F_SETFD, FD_CLOEXEC);
+  fcntl(out[1], F_SETFD, FD_CLOEXEC);
+  fcntl(err[0], F_SETFD, FD_CLOEXEC);
+
+#ifdef HAVE_POSIX_SPAWN
+  // posix_spawn avoids copying our page tables as fork would, which
+  // is expensive with a large heap (glibc uses vfork semantics here)
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, in[1], 1);
+  posix_spawn_file_actions_adddup2(&actions, out[0], 0);
+  posix_spawn_file_actions_adddup2(&actions, err[1], 2);
+  posix_spawn_file_actions_addclose(&actions, in[1]);
+  posix_spawn_file_actions_addclose(&actions, out[0]);
+  posix_spawn_file_actions_addclose(&actions, err[1]);
+
+  pid_t pid;
+  int r = posix_spawnp(&pid, argv[0], &actions, 0, argv, environ);
+
+  posix_spawn_file_actions_destroy(&actions);
+
+  safeClose(in[1]);
+  safeClose(out[0]);
+  safeClose(err[1]);
+
+  if (r != 0) {
+    safeClose(in[0]);
+    safeClose(out[1]);
+    safeClose(err[0]);
+    clean(e, command, argv);
+    errno = r;
+    throwNewErrno(e, "java/io/IOException");
+    return;
+  }
+#else
+  int msg[] = {-1, -1};
   makePipe(e, msg);
   if (e->ExceptionCheck())
     return;
@@ -715,16 +772,7 @@ extern "C" JNIEXPORT void JNICALL
     return;
   }
 
-#ifdef __QNX__
-  // fork(2) doesn't work in multithreaded QNX programs.  See
-  // http://www.qnx.com/developers/docs/6.4.1/neutrino/getting_started/s1_procs.html
-  pid_t pid = vfork();
-#else
-  // We might be able to just use vfork on all UNIX-style systems, but
-  // the manual makes it sound dangerous due to the shared
-  // parent/child address space, so we use fork if we can.
   pid_t pid = fork();
-#endif
   switch (pid) {
   case -1:  // error
     throwNewErrno(e, "java/io/IOException");
@@ -748,9 +796,6 @@ extern "C" JNIEXPORT void JNICALL
   } break;
 
   default: {  // parent
-    jlong JNIPid = static_cast<jlong>(pid);
-    e->SetLongArrayRegion(process, 0, 1, &JNIPid);
-
     safeClose(in[1]);
     safeClose(out[0]);
     safeClose(err[1]);
@@ -770,15 +815,27 @@ extern "C" JNIEXPORT void JNICALL
   }
 
   safeClose(msg[0]);
+#endif
+
   clean(e, command, argv);
 
-  fcntl(in[0], F_SETFD, FD_CLOEXEC);
-  fcntl(out[1], F_SETFD, FD_CLOEXEC);
-  fcntl(err[0], F_SETFD, FD_CLOEXEC);
+  jlong JNIPid = static_cast<jlong>(pid);
+  e->SetLongArrayRegion(process, 0, 1, &JNIPid);
+
+  // A pidfd lets Runtime wait for many children on one thread, and
+  // plays the role of the thread handle on Windows: waitFor closes it.
+  jlong pidfd = -1;
+#ifdef __NR_pidfd_open
+  pidfd = syscall(__NR_pidfd_open, pid, 0);
+  if (pidfd < 0) {
+    pidfd = -1;
+  }
+#endif
+  e->SetLongArrayRegion(process, 1, 1, &pidfd);
 }
 
 extern "C" JNIEXPORT jint JNICALL
-    Java_java_lang_Runtime_waitFor(JNIEnv*, jclass, jlong pid, jlong)
+    Java_java_lang_Runtime_waitFor(JNIEnv*, jclass, jlong pid, jlong pidfd)
 {
   bool finished = false;
   int status;
@@ -794,9 +851,88 @@ extern "C" JNIEXPORT jint JNICALL
     }
   }
 
+  if (pidfd >= 0) {
+    close(pidfd);
+  }
+
   return exitCode;
 }
 
+extern "C" JNIEXPORT jboolean JNICALL
+    Java_java_lang_Runtime_pidfdSupported(JNIEnv*, jclass)
+{
+#ifdef __NR_pidfd_open
+  int fd = syscall(__NR_pidfd_open, getpid(), 0);
+  if (fd >= 0) {
+    close(fd);
+    return true;
+  }
+#endif
+  return false;
+}
+
+extern "C" JNIEXPORT void JNICALL
+    Java_java_lang_Runtime_makePipe(JNIEnv* e, jclass, jintArray descriptors)
+{
+  int p[2];
+  makePipe(e, p);
+  if (e->ExceptionCheck())
+    return;
+
+  fcntl(p[0], F_SETFD, FD_CLOEXEC);
+  fcntl(p[1], F_SETFD, FD_CLOEXEC);
+
+  jint body[] = {p[0], p[1]};
+  e->SetIntArrayRegion(descriptors, 0, 2, body);
+}
+
+// Blocks until either one of the specified pidfds becomes readable,
+// meaning its process has exited, or something is written to the wake
+// descriptor.  Returns the index of the former, or -1 for the latter.
+extern "C" JNIEXPORT jint JNICALL
+    Java_java_lang_Runtime_waitAny(JNIEnv* e,
+                                   jclass,
+                                   jintArray descriptors,
+                                   jint wake)
+{
+  jsize count = e->GetArrayLength(descriptors);
+  pollfd* fds = static_cast<pollfd*>(allocate(e, (count + 1) * sizeof(pollfd)));
+  if (fds == 0) {
+    return -1;
+  }
+
+  jint* body = e->GetIntArrayElements(descriptors, 0);
+  for (jsize i = 0; i < count; ++i) {
+    fds[i].fd = body[i];
+    fds[i].events = POLLIN;
+    fds[i].revents = 0;
+  }
+  e->ReleaseIntArrayElements(descriptors, body, JNI_ABORT);
+
+  fds[count].fd = wake;
+  fds[count].events = POLLIN;
+  fds[count].revents = 0;
+
+  jint result = -1;
+  if (poll(fds, count + 1, -1) > 0) {
+    if (fds[count].revents) {
+      char buffer[64];
+      ssize_t r UNUSED = read(wake, buffer, sizeof(buffer));
+    }
+
+    for (jsize i = 0; i < count; ++i) {
+      if (fds[i].revents) {
+        result = i;
+        break;
+      }
+    }
+  }
+
+  free(fds);
+
+  return result;
+}
+
 extern "C" JNIEXPORT void JNICALL
     Java_java_lang_Runtime_kill(JNIEnv*, jclass, jlong pid)
 {
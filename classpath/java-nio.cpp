@@ -36,6 +36,18 @@
 #include <netinet/ip.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#endif
+
+#ifdef __linux__
+#define HAVE_EPOLL
+#define HAVE_MMSG
+#define HAVE_SENDFILE
+#include <limits.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
 #endif
 
 #define java_nio_channels_SelectionKey_OP_READ 1L
@@ -43,8 +55,18 @@
 #define java_nio_channels_SelectionKey_OP_CONNECT 8L
 #define java_nio_channels_SelectionKey_OP_ACCEPT 16L
 
+// ordinals of java.nio.channels.FileChannel.MapMode
+#define java_nio_channels_FileChannel_MapMode_PRIVATE 0
+#define java_nio_channels_FileChannel_MapMode_READ_ONLY 1
+#define java_nio_channels_FileChannel_MapMode_READ_WRITE 2
+
 #ifdef PLATFORM_WINDOWS
 typedef int socklen_t;
+
+struct iovec {
+  void* iov_base;
+  size_t iov_len;
+};
 #endif
 
 inline void* operator new(size_t, void* p) throw()
@@ -371,6 +393,173 @@ int makeSocket(JNIEnv* e, int type = SOCK_STREAM, int protocol = IPPROTO_TCP)
   return s;
 }
 
+int doReadv(int fd, iovec* vector, int count)
+{
+#ifdef PLATFORM_WINDOWS
+  int total = 0;
+  for (int i = 0; i < count; ++i) {
+    int r = doRead(fd, vector[i].iov_base, vector[i].iov_len);
+    if (r < 0) {
+      return total ? total : r;
+    }
+    total += r;
+    if (static_cast<size_t>(r) < vector[i].iov_len) {
+      break;
+    }
+  }
+  return total;
+#else
+  return ::readv(fd, vector, count);
+#endif
+}
+
+int doWritev(int fd, iovec* vector, int count)
+{
+#ifdef PLATFORM_WINDOWS
+  int total = 0;
+  for (int i = 0; i < count; ++i) {
+    int r = doWrite(fd, vector[i].iov_base, vector[i].iov_len);
+    if (r < 0) {
+      return total ? total : r;
+    }
+    total += r;
+    if (static_cast<size_t>(r) < vector[i].iov_len) {
+      break;
+    }
+  }
+  return total;
+#else
+  return ::writev(fd, vector, count);
+#endif
+}
+
+// Translates a java.nio.channels.BufferVector into an iovec array.
+// Heap arrays are pinned with GetPrimitiveArrayCritical, which is a
+// direct pointer for large (fixed) arrays and a copy otherwise, and
+// direct buffers are used in place.
+class BufferVector {
+ public:
+  BufferVector(JNIEnv* e,
+               jobjectArray buffers,
+               jobjectArray arrays,
+               jintArray offsets,
+               jintArray lengths,
+               jint count)
+      : e(e),
+        arrays(arrays),
+        vector(static_cast<iovec*>(allocate(e, count * sizeof(iovec)))),
+        bodies(static_cast<jbyte**>(allocate(e, count * sizeof(jbyte*)))),
+        count(0)
+  {
+    if (vector == 0 or bodies == 0) {
+      return;
+    }
+
+    jint* offsetBody = e->GetIntArrayElements(offsets, 0);
+    jint* lengthBody = e->GetIntArrayElements(lengths, 0);
+
+    for (jint i = 0; i < count; ++i) {
+      jbyteArray array
+          = static_cast<jbyteArray>(e->GetObjectArrayElement(arrays, i));
+
+      jbyte* base;
+      if (array) {
+        base = static_cast<jbyte*>(e->GetPrimitiveArrayCritical(array, 0));
+        bodies[i] = base;
+        e->DeleteLocalRef(array);
+      } else {
+        jobject buffer = e->GetObjectArrayElement(buffers, i);
+        base = static_cast<jbyte*>(e->GetDirectBufferAddress(buffer));
+        bodies[i] = 0;
+        e->DeleteLocalRef(buffer);
+      }
+
+      if (base == 0) {
+        throwNew(e, "java/lang/IllegalArgumentException", 0);
+        break;
+      }
+
+      vector[i].iov_base = base + offsetBody[i];
+      vector[i].iov_len = lengthBody[i];
+      this->count = i + 1;
+    }
+
+    e->ReleaseIntArrayElements(offsets, offsetBody, JNI_ABORT);
+    e->ReleaseIntArrayElements(lengths, lengthBody, JNI_ABORT);
+  }
+
+  // mode is passed to ReleasePrimitiveArrayCritical: zero to copy
+  // back what was read, or JNI_ABORT after a write
+  void dispose(jint mode)
+  {
+    for (jint i = 0; i < count; ++i) {
+      if (bodies[i]) {
+        jbyteArray array
+            = static_cast<jbyteArray>(e->GetObjectArrayElement(arrays, i));
+        e->ReleasePrimitiveArrayCritical(array, bodies[i], mode);
+        e->DeleteLocalRef(array);
+      }
+    }
+
+    free(vector);
+    free(bodies);
+  }
+
+  JNIEnv* e;
+  jobjectArray arrays;
+  iovec* vector;
+  jbyte** bodies;
+  jint count;
+};
+
+#ifdef HAVE_SENDFILE
+// the most we ask the kernel to transfer at once
+const size_t MaxTransfer = 1 << 30;
+
+// the most we move through a pipe per splice
+const size_t SpliceSize = 64 * 1024;
+
+ssize_t copyFileRange(int in, loff_t* inOffset, int out, loff_t* outOffset,
+                      size_t count)
+{
+#ifdef __NR_copy_file_range
+  return syscall(__NR_copy_file_range, in, inOffset, out, outOffset, count, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+// moves count bytes from a socket to a file through a pipe without
+// copying them into user space
+ssize_t spliceThrough(int in, int* pipe, int out, loff_t* outOffset,
+                      size_t count)
+{
+  ssize_t r = splice(in,
+                     0,
+                     pipe[1],
+                     0,
+                     count < SpliceSize ? count : SpliceSize,
+                     SPLICE_F_MOVE);
+  if (r <= 0) {
+    return r;
+  }
+
+  // whatever made it into the pipe must make it into the file, or it
+  // would be lost
+  for (ssize_t remaining = r; remaining;) {
+    ssize_t n = splice(pipe[0], 0, out, outOffset, remaining, SPLICE_F_MOVE);
+    if (n < 0 and errno != EINTR) {
+      return n;
+    } else if (n > 0) {
+      remaining -= n;
+    }
+  }
+
+  return r;
+}
+#endif
+
 }  // namespace <anonymous>
 
 extern "C" JNIEXPORT jint JNICALL
@@ -688,6 +877,290 @@ extern "C" JNIEXPORT jint JNICALL
   return r;
 }
 
+extern "C" JNIEXPORT jlong JNICALL
+    Java_java_nio_channels_SocketChannel_natReadv(JNIEnv* e,
+                                                  jclass,
+                                                  jint socket,
+                                                  jobjectArray buffers,
+                                                  jobjectArray arrays,
+                                                  jintArray offsets,
+                                                  jintArray lengths,
+                                                  jint count)
+{
+  BufferVector v(e, buffers, arrays, offsets, lengths, count);
+  if (e->ExceptionCheck()) {
+    v.dispose(JNI_ABORT);
+    return 0;
+  }
+
+  int r = ::doReadv(socket, v.vector, v.count);
+
+  v.dispose(r > 0 ? 0 : JNI_ABORT);
+
+  if (r < 0) {
+    if (eagain()) {
+      return 0;
+    } else {
+      throwIOException(e);
+    }
+  } else if (r == 0) {
+    return -1;
+  }
+  return r;
+}
+
+extern "C" JNIEXPORT jlong JNICALL
+    Java_java_nio_channels_SocketChannel_natWritev(JNIEnv* e,
+                                                   jclass,
+                                                   jint socket,
+                                                   jobjectArray buffers,
+                                                   jobjectArray arrays,
+                                                   jintArray offsets,
+                                                   jintArray lengths,
+                                                   jint count)
+{
+  BufferVector v(e, buffers, arrays, offsets, lengths, count);
+  if (e->ExceptionCheck()) {
+    v.dispose(JNI_ABORT);
+    return 0;
+  }
+
+  int r = ::doWritev(socket, v.vector, v.count);
+
+  v.dispose(JNI_ABORT);
+
+  if (r < 0) {
+    if (eagain()) {
+      return 0;
+    } else {
+      throwIOException(e);
+    }
+  }
+  return r;
+}
+
+extern "C" JNIEXPORT jint JNICALL
+    Java_java_nio_channels_DatagramChannel_sendBatch(JNIEnv* e,
+                                                     jclass,
+                                                     jint socket,
+                                                     jobjectArray buffers,
+                                                     jobjectArray arrays,
+                                                     jintArray offsets,
+                                                     jintArray lengths,
+                                                     jint count,
+                                                     jintArray addresses)
+{
+  BufferVector v(e, buffers, arrays, offsets, lengths, count);
+  if (e->ExceptionCheck()) {
+    v.dispose(JNI_ABORT);
+    return 0;
+  }
+
+  sockaddr_in* targets = 0;
+  if (addresses) {
+    targets = static_cast<sockaddr_in*>(
+        allocate(e, v.count * sizeof(sockaddr_in)));
+    if (targets == 0) {
+      v.dispose(JNI_ABORT);
+      return 0;
+    }
+
+    jint* body = e->GetIntArrayElements(addresses, 0);
+    for (jint i = 0; i < v.count; ++i) {
+      init(targets + i, body[i * 2], body[(i * 2) + 1]);
+    }
+    e->ReleaseIntArrayElements(addresses, body, JNI_ABORT);
+  }
+
+  jint* sent = static_cast<jint*>(allocate(e, v.count * sizeof(jint)));
+  if (sent == 0) {
+    free(targets);
+    v.dispose(JNI_ABORT);
+    return 0;
+  }
+
+  int r;
+#ifdef HAVE_MMSG
+  mmsghdr* messages
+      = static_cast<mmsghdr*>(allocate(e, v.count * sizeof(mmsghdr)));
+  if (messages == 0) {
+    free(sent);
+    free(targets);
+    v.dispose(JNI_ABORT);
+    return 0;
+  }
+
+  memset(messages, 0, v.count * sizeof(mmsghdr));
+  for (jint i = 0; i < v.count; ++i) {
+    messages[i].msg_hdr.msg_iov = v.vector + i;
+    messages[i].msg_hdr.msg_iovlen = 1;
+    if (targets) {
+      messages[i].msg_hdr.msg_name = targets + i;
+      messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    }
+  }
+
+  r = ::sendmmsg(socket, messages, v.count, 0);
+
+  for (int i = 0; i < r; ++i) {
+    sent[i] = messages[i].msg_len;
+  }
+
+  free(messages);
+#else
+  // no batch system call here, so send one message at a time until
+  // the socket would block
+  r = 0;
+  for (jint i = 0; i < v.count; ++i) {
+    int n = targets ? ::doSend(socket,
+                               targets + i,
+                               v.vector[i].iov_base,
+                               v.vector[i].iov_len)
+                    : ::doWrite(socket,
+                                v.vector[i].iov_base,
+                                v.vector[i].iov_len);
+    if (n < 0) {
+      if (r == 0) {
+        r = -1;
+      }
+      break;
+    }
+    sent[r++] = n;
+  }
+#endif
+
+  v.dispose(JNI_ABORT);
+  free(targets);
+
+  if (r < 0) {
+    free(sent);
+    if (eagain()) {
+      return 0;
+    } else {
+      throwIOException(e);
+      return 0;
+    }
+  }
+
+  e->SetIntArrayRegion(lengths, 0, r, sent);
+  free(sent);
+
+  return r;
+}
+
+extern "C" JNIEXPORT jint JNICALL
+    Java_java_nio_channels_DatagramChannel_receiveBatch(JNIEnv* e,
+                                                        jclass,
+                                                        jint socket,
+                                                        jobjectArray buffers,
+                                                        jobjectArray arrays,
+                                                        jintArray offsets,
+                                                        jintArray lengths,
+                                                        jint count,
+                                                        jintArray addresses)
+{
+  BufferVector v(e, buffers, arrays, offsets, lengths, count);
+  if (e->ExceptionCheck()) {
+    v.dispose(JNI_ABORT);
+    return 0;
+  }
+
+  // each message yields a byte count, a host, and a port:
+  jint* results = static_cast<jint*>(allocate(e, v.count * 3 * sizeof(jint)));
+  sockaddr_in* sources = static_cast<sockaddr_in*>(
+      allocate(e, v.count * sizeof(sockaddr_in)));
+  if (results == 0 or sources == 0) {
+    free(results);
+    free(sources);
+    v.dispose(JNI_ABORT);
+    return 0;
+  }
+
+  int r;
+#ifdef HAVE_MMSG
+  mmsghdr* messages
+      = static_cast<mmsghdr*>(allocate(e, v.count * sizeof(mmsghdr)));
+  if (messages == 0) {
+    free(results);
+    free(sources);
+    v.dispose(JNI_ABORT);
+    return 0;
+  }
+
+  memset(messages, 0, v.count * sizeof(mmsghdr));
+  for (jint i = 0; i < v.count; ++i) {
+    messages[i].msg_hdr.msg_iov = v.vector + i;
+    messages[i].msg_hdr.msg_iovlen = 1;
+    messages[i].msg_hdr.msg_name = sources + i;
+    messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+  }
+
+  // MSG_WAITFORONE makes a blocking socket wait for the first message
+  // only, and then take whatever else is already queued
+  r = ::recvmmsg(socket, messages, v.count, MSG_WAITFORONE, 0);
+
+  for (int i = 0; i < r; ++i) {
+    results[i] = messages[i].msg_len;
+  }
+
+  free(messages);
+#else
+  r = 0;
+  for (jint i = 0; i < v.count; ++i) {
+    // only the first message may block
+#ifdef MSG_DONTWAIT
+    int flags = i ? MSG_DONTWAIT : 0;
+#else
+    if (i) {
+      break;
+    }
+    int flags = 0;
+#endif
+
+    socklen_t length = sizeof(sockaddr_in);
+    int n = recvfrom(socket,
+                     static_cast<char*>(v.vector[i].iov_base),
+                     v.vector[i].iov_len,
+                     flags,
+                     reinterpret_cast<sockaddr*>(sources + i),
+                     &length);
+    if (n < 0) {
+      if (r == 0) {
+        r = -1;
+      }
+      break;
+    }
+    results[r++] = n;
+  }
+#endif
+
+  v.dispose(r > 0 ? 0 : JNI_ABORT);
+
+  if (r < 0) {
+    free(results);
+    free(sources);
+    if (eagain()) {
+      return 0;
+    } else {
+      throwIOException(e);
+      return 0;
+    }
+  }
+
+  for (int i = 0; i < r; ++i) {
+    results[v.count + (i * 2)] = ntohl(sources[i].sin_addr.s_addr);
+    results[v.count + (i * 2) + 1] = ntohs(sources[i].sin_port);
+  }
+
+  e->SetIntArrayRegion(lengths, 0, r, results);
+  e->SetIntArrayRegion(addresses, 0, r * 2, results + v.count);
+
+  free(results);
+  free(sources);
+
+  return r;
+}
+
 extern "C" JNIEXPORT void JNICALL
     Java_java_nio_channels_SocketChannel_natThrowWriteError(JNIEnv* e,
                                                             jclass,
@@ -862,15 +1335,47 @@ struct SelectorState {
   fd_set write;
   fd_set except;
   Pipe control;
+#ifdef HAVE_EPOLL
+  // sockets stay registered with the epoll instance between selects,
+  // and only interest changes are passed to the kernel:
+  int epoll;
+  bool edgeTriggered;
+  epoll_event* events;
+  unsigned capacity;
+#endif
   SelectorState(JNIEnv* e) : control(e)
   {
   }
 };
 
+void drainControl(JNIEnv* e, SelectorState* s)
+{
+  char c;
+  int r = 1;
+  while (r == 1) {
+    r = ::doRead(s->control.reader(), &c, 1);
+  }
+  if (r < 0 and not eagain()) {
+    throwIOException(e);
+  }
+}
+
 }  // namespace
 
+extern "C" JNIEXPORT jboolean JNICALL
+    Java_java_nio_channels_SocketSelector_natUseEpoll(JNIEnv*, jclass)
+{
+#ifdef HAVE_EPOLL
+  return true;
+#else
+  return false;
+#endif
+}
+
 extern "C" JNIEXPORT jlong JNICALL
-    Java_java_nio_channels_SocketSelector_natInit(JNIEnv* e, jclass)
+    Java_java_nio_channels_SocketSelector_natInit(JNIEnv* e,
+                                                  jclass,
+                                                  jboolean edgeTriggered UNUSED)
 {
   void* mem = malloc(sizeof(SelectorState));
   if (mem) {
@@ -882,6 +1387,34 @@ extern "C" JNIEXPORT jlong JNICALL
       FD_ZERO(&(s->read));
       FD_ZERO(&(s->write));
       FD_ZERO(&(s->except));
+
+#ifdef HAVE_EPOLL
+      s->edgeTriggered = edgeTriggered;
+      s->events = 0;
+      s->capacity = 0;
+
+      s->epoll = epoll_create1(EPOLL_CLOEXEC);
+      if (s->epoll < 0) {
+        throwIOException(e);
+        s->control.dispose();
+        free(s);
+        return 0;
+      }
+
+      epoll_event event;
+      memset(&event, 0, sizeof(epoll_event));
+      event.events = EPOLLIN;
+      event.data.fd = s->control.reader();
+      if (epoll_ctl(s->epoll, EPOLL_CTL_ADD, s->control.reader(), &event)
+          != 0) {
+        throwIOException(e);
+        ::doClose(s->epoll);
+        s->control.dispose();
+        free(s);
+        return 0;
+      }
+#endif
+
       return reinterpret_cast<jlong>(s);
     }
   }
@@ -909,6 +1442,10 @@ extern "C" JNIEXPORT void JNICALL
 {
   SelectorState* s = reinterpret_cast<SelectorState*>(state);
   s->control.dispose();
+#ifdef HAVE_EPOLL
+  ::doClose(s->epoll);
+  free(s->events);
+#endif
   free(s);
 }
 
@@ -1038,14 +1575,7 @@ extern "C" JNIEXPORT jint JNICALL
   if (s->control.reader() >= 0 and FD_ISSET(s->control.reader(), &(s->read))) {
     FD_CLR(static_cast<unsigned>(s->control.reader()), &(s->read));
 
-    char c;
-    int r = 1;
-    while (r == 1) {
-      r = ::doRead(s->control.reader(), &c, 1);
-    }
-    if (r < 0 and not eagain()) {
-      throwIOException(e);
-    }
+    drainControl(e, s);
   }
 
   return r;
@@ -1084,6 +1614,400 @@ extern "C" JNIEXPORT jint JNICALL
   return ready;
 }
 
+extern "C" JNIEXPORT void JNICALL
+    Java_java_nio_channels_SocketSelector_natEpollUpdate(JNIEnv* e,
+                                                         jclass,
+                                                         jlong state UNUSED,
+                                                         jint socket UNUSED,
+                                                         jint interest UNUSED)
+{
+#ifdef HAVE_EPOLL
+  SelectorState* s = reinterpret_cast<SelectorState*>(state);
+
+  if (interest == 0) {
+    // even an empty event mask would still report hangups and errors,
+    // so we drop the socket until it's interested in something again:
+    if (epoll_ctl(s->epoll, EPOLL_CTL_DEL, socket, 0) != 0 and errno != ENOENT
+        and errno != EBADF) {
+      throwIOException(e);
+    }
+    return;
+  }
+
+  epoll_event event;
+  memset(&event, 0, sizeof(epoll_event));
+  event.data.fd = socket;
+
+  if (interest & (java_nio_channels_SelectionKey_OP_READ
+                  | java_nio_channels_SelectionKey_OP_ACCEPT)) {
+    event.events |= EPOLLIN;
+  }
+
+  if (interest & (java_nio_channels_SelectionKey_OP_WRITE
+                  | java_nio_channels_SelectionKey_OP_CONNECT)) {
+    event.events |= EPOLLOUT;
+  }
+
+  if (s->edgeTriggered) {
+    event.events |= EPOLLET;
+  }
+
+  if (epoll_ctl(s->epoll, EPOLL_CTL_MOD, socket, &event) != 0) {
+    if (errno != ENOENT
+        or epoll_ctl(s->epoll, EPOLL_CTL_ADD, socket, &event) != 0) {
+      throwIOException(e);
+    }
+  }
+#else
+  throwIOException(e, "epoll not supported");
+#endif
+}
+
+extern "C" JNIEXPORT jint JNICALL
+    Java_java_nio_channels_SocketSelector_natDoEpollSelect(
+        JNIEnv* e,
+        jclass,
+        jlong state UNUSED,
+        jintArray ready UNUSED,
+        jlong interval UNUSED)
+{
+#ifdef HAVE_EPOLL
+  SelectorState* s = reinterpret_cast<SelectorState*>(state);
+
+  // each ready socket is reported as a (socket, ready ops) pair:
+  unsigned capacity = e->GetArrayLength(ready) / 2;
+  if (s->capacity < capacity) {
+    epoll_event* events = static_cast<epoll_event*>(
+        realloc(s->events, capacity * sizeof(epoll_event)));
+    if (events == 0) {
+      throwNew(e, "java/lang/OutOfMemoryError", 0);
+      return 0;
+    }
+    s->events = events;
+    s->capacity = capacity;
+  }
+
+  int timeout;
+  if (interval > 0) {
+    timeout = interval > INT_MAX ? INT_MAX : interval;
+  } else if (interval < 0) {
+    timeout = 0;
+  } else {
+    timeout = -1;
+  }
+
+  int r = epoll_wait(s->epoll, s->events, capacity, timeout);
+  if (r < 0) {
+    if (errno != EINTR) {
+      throwIOException(e);
+    }
+    return 0;
+  }
+
+  bool woken = false;
+  jint count = 0;
+  jint* body = static_cast<jint*>(e->GetPrimitiveArrayCritical(ready, 0));
+  for (int i = 0; i < r; ++i) {
+    epoll_event* event = s->events + i;
+    if (event->data.fd == s->control.reader()) {
+      woken = true;
+      continue;
+    }
+
+    jint ops = 0;
+    if (event->events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+      ops |= java_nio_channels_SelectionKey_OP_READ
+             | java_nio_channels_SelectionKey_OP_ACCEPT;
+    }
+
+    if (event->events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+      ops |= java_nio_channels_SelectionKey_OP_WRITE
+             | java_nio_channels_SelectionKey_OP_CONNECT;
+    }
+
+    body[count * 2] = event->data.fd;
+    body[(count * 2) + 1] = ops;
+    ++count;
+  }
+  e->ReleasePrimitiveArrayCritical(ready, body, 0);
+
+  if (woken) {
+    drainControl(e, s);
+  }
+
+  return count;
+#else
+  throwIOException(e, "epoll not supported");
+  return 0;
+#endif
+}
+
+extern "C" JNIEXPORT void JNICALL
+    Java_java_nio_channels_FileChannel_natForce(JNIEnv* e,
+                                                jclass,
+                                                jlong descriptor,
+                                                jboolean metaData UNUSED)
+{
+#ifdef PLATFORM_WINDOWS
+  if (_commit(descriptor) != 0) {
+    throwIOException(e);
+  }
+#elif defined __linux__
+  if ((metaData ? fsync(descriptor) : fdatasync(descriptor)) != 0) {
+    throwIOException(e);
+  }
+#else
+  if (fsync(descriptor) != 0) {
+    throwIOException(e);
+  }
+#endif
+}
+
+extern "C" JNIEXPORT jobject JNICALL
+    Java_java_nio_channels_FileChannel_natMap(JNIEnv* e,
+                                              jclass,
+                                              jlong descriptor UNUSED,
+                                              jint mode UNUSED,
+                                              jlong position UNUSED,
+                                              jlong size UNUSED)
+{
+#ifdef PLATFORM_WINDOWS
+  throwNew(e, "java/lang/UnsupportedOperationException", 0);
+  return 0;
+#else
+  int fd = descriptor;
+
+  int protection;
+  int flags;
+  switch (mode) {
+  case java_nio_channels_FileChannel_MapMode_READ_ONLY:
+    protection = PROT_READ;
+    flags = MAP_SHARED;
+    break;
+
+  case java_nio_channels_FileChannel_MapMode_READ_WRITE:
+    protection = PROT_READ | PROT_WRITE;
+    flags = MAP_SHARED;
+    break;
+
+  default:
+    protection = PROT_READ | PROT_WRITE;
+    flags = MAP_PRIVATE;
+    break;
+  }
+
+  if (mode == java_nio_channels_FileChannel_MapMode_READ_WRITE) {
+    // a writable mapping may extend the file, as in the JDK
+    struct stat s;
+    if (fstat(fd, &s) != 0) {
+      throwIOException(e);
+      return 0;
+    }
+
+    if (s.st_size < position + size
+        and ftruncate(fd, position + size) != 0) {
+      throwIOException(e);
+      return 0;
+    }
+  }
+
+  // mappings must start on a page boundary
+  jlong offset = position % sysconf(_SC_PAGESIZE);
+  jlong length = size ? size + offset : 0;
+
+  void* base = 0;
+  if (length) {
+    base = mmap(0, length, protection, flags, fd, position - offset);
+    if (base == MAP_FAILED) {
+      throwIOException(e);
+      return 0;
+    }
+  }
+
+  jboolean readOnly = mode == java_nio_channels_FileChannel_MapMode_READ_ONLY;
+
+  jobject buffer = 0;
+  jclass c = e->FindClass("java/nio/MappedFileByteBuffer");
+  if (c) {
+    jmethodID constructor = e->GetMethodID(c, "<init>", "(JJIIZ)V");
+    if (constructor) {
+      buffer = e->NewObject(c,
+                            constructor,
+                            reinterpret_cast<jlong>(base),
+                            length,
+                            static_cast<jint>(offset),
+                            static_cast<jint>(size),
+                            readOnly);
+    }
+  }
+
+  if (buffer == 0 and length) {
+    munmap(base, length);
+  }
+
+  return buffer;
+#endif
+}
+
+extern "C" JNIEXPORT jlong JNICALL
+    Java_java_nio_channels_FileChannel_natTransfer(JNIEnv* e UNUSED,
+                                                   jclass,
+                                                   jlong in UNUSED,
+                                                   jlong inPosition UNUSED,
+                                                   jlong out UNUSED,
+                                                   jlong outPosition UNUSED,
+                                                   jlong count UNUSED)
+{
+#ifdef HAVE_SENDFILE
+  loff_t inOffset = inPosition;
+  loff_t outOffset = outPosition;
+  loff_t* inOffsetPointer = inPosition < 0 ? 0 : &inOffset;
+  loff_t* outOffsetPointer = outPosition < 0 ? 0 : &outOffset;
+
+  // file to file transfers try copy_file_range first, which may be
+  // done entirely by the file system, and then sendfile
+  bool copyRange = inOffsetPointer and outOffsetPointer;
+  bool seeked = false;
+
+  int pipe[2] = {-1, -1};
+
+  jlong total = 0;
+  while (total < count) {
+    size_t n = count - total < static_cast<jlong>(MaxTransfer)
+                   ? count - total
+                   : MaxTransfer;
+
+    ssize_t r;
+    if (copyRange) {
+      r = copyFileRange(in, inOffsetPointer, out, outOffsetPointer, n);
+      if (r < 0 and total == 0
+          and (errno == ENOSYS or errno == EXDEV or errno == EINVAL
+               or errno == EOPNOTSUPP or errno == EBADF)) {
+        copyRange = false;
+        continue;
+      }
+    } else if (inOffsetPointer) {
+      if (outOffsetPointer and not seeked) {
+        // sendfile writes at (and advances) the file position
+        if (lseek(out, outOffset, SEEK_SET) < 0) {
+          throwIOException(e);
+          break;
+        }
+        seeked = true;
+      }
+
+      r = sendfile(out, in, inOffsetPointer, n);
+      if (r < 0 and total == 0 and (errno == EINVAL or errno == ENOSYS)) {
+        total = -1;
+        break;
+      }
+    } else {
+      if (pipe[0] < 0 and ::pipe(pipe) != 0) {
+        throwIOException(e);
+        break;
+      }
+
+      r = spliceThrough(in, pipe, out, outOffsetPointer, n);
+      if (r < 0 and total == 0 and (errno == EINVAL or errno == ENOSYS)) {
+        total = -1;
+        break;
+      }
+    }
+
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      } else if (not eagain()) {
+        throwIOException(e);
+      }
+      break;
+    } else if (r == 0) {
+      break;
+    }
+
+    total += r;
+  }
+
+  if (pipe[0] >= 0) {
+    ::doClose(pipe[0]);
+    ::doClose(pipe[1]);
+  }
+
+  return total;
+#else
+  return -1;
+#endif
+}
+
+extern "C" JNIEXPORT void JNICALL
+    Java_java_nio_MappedFileByteBuffer_force(JNIEnv* e UNUSED,
+                                             jclass,
+                                             jlong base UNUSED,
+                                             jlong length UNUSED)
+{
+#ifndef PLATFORM_WINDOWS
+  if (msync(reinterpret_cast<void*>(base), length, MS_SYNC) != 0) {
+    throwIOException(e);
+  }
+#endif
+}
+
+extern "C" JNIEXPORT void JNICALL
+    Java_java_nio_MappedFileByteBuffer_load(JNIEnv*,
+                                            jclass,
+                                            jlong base UNUSED,
+                                            jlong length UNUSED)
+{
+#ifndef PLATFORM_WINDOWS
+  // only a hint, so failure is harmless
+  madvise(reinterpret_cast<void*>(base), length, MADV_WILLNEED);
+#endif
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+    Java_java_nio_MappedFileByteBuffer_isLoaded(JNIEnv*,
+                                                jclass,
+                                                jlong base UNUSED,
+                                                jlong length UNUSED)
+{
+#ifdef PLATFORM_WINDOWS
+  return true;
+#else
+  long pageSize = sysconf(_SC_PAGESIZE);
+  size_t pageCount = (length + pageSize - 1) / pageSize;
+  unsigned char* vector = static_cast<unsigned char*>(malloc(pageCount));
+  if (vector == 0) {
+    return false;
+  }
+
+#ifdef __APPLE__
+  char* v = reinterpret_cast<char*>(vector);
+#else
+  unsigned char* v = vector;
+#endif
+
+  bool loaded = mincore(reinterpret_cast<void*>(base), length, v) == 0;
+  for (size_t i = 0; loaded and i < pageCount; ++i) {
+    loaded = (vector[i] & 1) != 0;
+  }
+
+  free(vector);
+
+  return loaded;
+#endif
+}
+
+extern "C" JNIEXPORT void JNICALL
+    Java_java_nio_MappedFileByteBuffer_unmap(JNIEnv*,
+                                             jclass,
+                                             jlong base UNUSED,
+                                             jlong length UNUSED)
+{
+#ifndef PLATFORM_WINDOWS
+  munmap(reinterpret_cast<void*>(base), length);
+#endif
+}
+
 extern "C" JNIEXPORT jboolean JNICALL
     Java_java_nio_ByteOrder_isNativeBigEndian(JNIEnv*, jclass)
 {
@@ -244,7 +244,11 @@ public class RandomAccessFile implements DataInput, Closeable {
         if (!dst.hasArray()) throw new IOException("Cannot handle " + dst.getClass());
 	// TODO: this needs to be synchronized on the Buffer, no?
         byte[] array = dst.array();
-        return readBytes(peer, position, array, dst.position(), dst.remaining());
+        int count = readBytes(peer, position, array,
+                              dst.arrayOffset() + dst.position(),
+                              dst.remaining());
+        if (count > 0) dst.position(dst.position() + count);
+        return count;
       }
 
       public int read(ByteBuffer dst) throws IOException {
@@ -256,7 +260,11 @@ public class RandomAccessFile implements DataInput, Closeable {
       public int write(ByteBuffer src, long position) throws IOException {
         if (!src.hasArray()) throw new IOException("Cannot handle " + src.getClass());
         byte[] array = src.array();
-        return writeBytes(peer, position, array, src.position(), src.remaining());
+        int count = writeBytes(peer, position, array,
+                               src.arrayOffset() + src.position(),
+                               src.remaining());
+        if (count > 0) src.position(src.position() + count);
+        return count;
       }
 
       public int write(ByteBuffer src) throws IOException {
@@ -277,6 +285,10 @@ public class RandomAccessFile implements DataInput, Closeable {
       public long size() throws IOException {
         return length();
       }
+
+      protected long descriptor() {
+        return peer;
+      }
     };
   }
 }
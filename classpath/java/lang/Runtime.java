@@ -16,6 +16,7 @@ import java.io.FileInputStream;
 import java.io.OutputStream;
 import java.io.FileOutputStream;
 import java.io.FileDescriptor;
+import java.util.ArrayList;
 import java.util.StringTokenizer;
 
 public class Runtime {
@@ -53,64 +54,30 @@ public class Runtime {
   }
 
   public Process exec(final String[] command) throws IOException {
-    final MyProcess[] process = new MyProcess[1];
-    final Throwable[] exception = new Throwable[1];
+    final MyProcess p;
+    try {
+      long[] info = new long[5];
+      exec(command, info);
+      p = new MyProcess
+        (info[0], info[1], (int) info[2], (int) info[3], (int) info[4]);
+    } catch (IOException e) {
+      String message = "Failed to run \"" + command[0] + "\": " + e.getMessage();
+      throw new IOException(message);
+    }
 
-    synchronized (process) {
+    if (Reaper.Enabled && p.tid >= 0) {
+      Reaper.add(p);
+    } else {
       Thread t = new Thread() {
           public void run() {
-            synchronized (process) {
-              try {
-                long[] info = new long[5];
-                exec(command, info);
-                process[0] = new MyProcess
-                  (info[0], info[1], (int) info[2], (int) info[3],
-                   (int) info[4]);
-              } catch (Throwable e) {
-                exception[0] = e;
-              } finally {          
-                process.notifyAll();
-              }
-            }
-
-            MyProcess p = process[0];
-            if (p != null) {
-              synchronized (p) {
-                try {
-                  if (p.pid != 0) {
-                    p.exitCode = Runtime.waitFor(p.pid, p.tid);
-                    p.pid = 0;
-                    p.tid = 0;
-                  }
-                } finally {
-                  p.notifyAll();
-                }
-              }
-            }
+            p.reap();
           }
         };
       t.setDaemon(true);
       t.start();
-
-      while (process[0] == null && exception[0] == null) {
-        try {
-          process.wait();
-        } catch (InterruptedException e) {
-          throw new RuntimeException(e);
-        }
-      }
     }
 
-    if (exception[0] != null) {
-      if (exception[0] instanceof IOException) {
-        String message = "Failed to run \"" + command[0] + "\": " + exception[0].getMessage();
-        throw new IOException(message);
-      } else {
-        throw new RuntimeException(exception[0]);
-      }
-    }
-
-    return process[0];
+    return p;
   }
 
   public native void addShutdownHook(Thread t);
@@ -122,6 +89,12 @@ public class Runtime {
 
   private static native void kill(long pid);
 
+  private static native boolean pidfdSupported();
+
+  private static native void makePipe(int[] descriptors) throws IOException;
+
+  private static native int waitAny(int[] descriptors, int wake);
+
   public native void gc();
 
   public native void exit(int code);
@@ -181,5 +154,80 @@ public class Runtime {
 
       return exitCode;
     }
+
+    private synchronized void reap() {
+      try {
+        if (pid != 0) {
+          exitCode = Runtime.waitFor(pid, tid);
+          pid = 0;
+          tid = 0;
+        }
+      } finally {
+        notifyAll();
+      }
+    }
+  }
+
+  // Where the OS provides a descriptor for each child (a pidfd on
+  // Linux), a single thread waits for all of them to exit, rather than
+  // dedicating a thread to each.
+  private static class Reaper implements Runnable {
+    public static final boolean Enabled = pidfdSupported();
+
+    private static Reaper instance;
+
+    private final ArrayList<MyProcess> processes = new ArrayList();
+    private final int wakeReader;
+    private final OutputStream wakeWriter;
+
+    private Reaper() throws IOException {
+      int[] descriptors = new int[2];
+      makePipe(descriptors);
+      wakeReader = descriptors[0];
+      wakeWriter = new FileOutputStream(new FileDescriptor(descriptors[1]));
+    }
+
+    public static void add(MyProcess p) throws IOException {
+      Reaper reaper;
+      synchronized (Reaper.class) {
+        if (instance == null) {
+          instance = new Reaper();
+          Thread t = new Thread(instance);
+          t.setDaemon(true);
+          t.start();
+        }
+        reaper = instance;
+      }
+
+      synchronized (reaper) {
+        reaper.processes.add(p);
+      }
+
+      // make the reaper include the new process in its next wait
+      reaper.wakeWriter.write(0);
+    }
+
+    public void run() {
+      while (true) {
+        MyProcess[] array;
+        synchronized (this) {
+          array = processes.toArray(new MyProcess[processes.size()]);
+        }
+
+        int[] descriptors = new int[array.length];
+        for (int i = 0; i < array.length; ++i) {
+          descriptors[i] = (int) array[i].tid;
+        }
+
+        int index = waitAny(descriptors, wakeReader);
+        if (index >= 0) {
+          MyProcess p = array[index];
+          synchronized (this) {
+            processes.remove(p);
+          }
+          p.reap();
+        }
+      }
+    }
   }
 }
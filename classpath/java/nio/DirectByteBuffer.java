@@ -12,7 +12,7 @@ package java.nio;
 
 import sun.misc.Unsafe;
 
-class DirectByteBuffer extends ByteBuffer {
+class DirectByteBuffer extends MappedByteBuffer {
   private static final Unsafe unsafe = Unsafe.getUnsafe();
   private static final int baseOffset = unsafe.arrayBaseOffset(byte[].class);
 
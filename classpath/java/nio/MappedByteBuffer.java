@@ -0,0 +1,32 @@
+/* Copyright (c) 2008-2015, Avian Contributors
+
+   Permission to use, copy, modify, and/or distribute this software
+   for any purpose with or without fee is hereby granted, provided
+   that the above copyright notice and this permission notice appear
+   in all copies.
+
+   There is NO WARRANTY for this software.  See license.txt for
+   details. */
+
+package java.nio;
+
+public abstract class MappedByteBuffer extends ByteBuffer {
+  protected MappedByteBuffer(boolean readOnly) {
+    super(readOnly);
+  }
+
+  // buffers which aren't backed by a file have nothing to write back
+  // or page in, so these do nothing unless overridden
+
+  public MappedByteBuffer force() {
+    return this;
+  }
+
+  public MappedByteBuffer load() {
+    return this;
+  }
+
+  public boolean isLoaded() {
+    return true;
+  }
+}
@@ -0,0 +1,101 @@
+/* Copyright (c) 2008-2015, Avian Contributors
+
+   Permission to use, copy, modify, and/or distribute this software
+   for any purpose with or without fee is hereby granted, provided
+   that the above copyright notice and this permission notice appear
+   in all copies.
+
+   There is NO WARRANTY for this software.  See license.txt for
+   details. */
+
+package java.nio;
+
+// A buffer backed by a region of a file mapped into memory by
+// FileChannel.map.  The region is unmapped once neither this buffer
+// nor any slice or duplicate of it is reachable.
+class MappedFileByteBuffer extends DirectByteBuffer {
+  private final Mapping mapping;
+
+  private MappedFileByteBuffer(Mapping mapping, long address, int capacity,
+                               boolean readOnly)
+  {
+    super(address, capacity, readOnly);
+
+    this.mapping = mapping;
+  }
+
+  // called by FileChannel.natMap, where base and length describe the
+  // page-aligned mapping and offset is where the buffer starts in it
+  private MappedFileByteBuffer(long base, long length, int offset,
+                               int capacity, boolean readOnly)
+  {
+    this(new Mapping(base, length), base + offset, capacity, readOnly);
+  }
+
+  public ByteBuffer asReadOnlyBuffer() {
+    ByteBuffer b = new MappedFileByteBuffer(mapping, address, capacity, true);
+    b.position(position());
+    b.limit(limit());
+    return b;
+  }
+
+  public ByteBuffer slice() {
+    return new MappedFileByteBuffer
+      (mapping, address + position, remaining(), isReadOnly());
+  }
+
+  public ByteBuffer duplicate() {
+    ByteBuffer b = new MappedFileByteBuffer
+      (mapping, address, capacity, isReadOnly());
+    b.limit(this.limit());
+    b.position(this.position());
+    return b;
+  }
+
+  public MappedByteBuffer force() {
+    if (! isReadOnly()) {
+      force(mapping.base, mapping.length);
+    }
+    return this;
+  }
+
+  public MappedByteBuffer load() {
+    load(mapping.base, mapping.length);
+    return this;
+  }
+
+  public boolean isLoaded() {
+    return isLoaded(mapping.base, mapping.length);
+  }
+
+  public String toString() {
+    return "(MappedFileByteBuffer with address: " + address
+      + " position: " + position
+      + " limit: " + limit
+      + " capacity: " + capacity + ")";
+  }
+
+  private static native void force(long base, long length);
+
+  private static native void load(long base, long length);
+
+  private static native boolean isLoaded(long base, long length);
+
+  private static native void unmap(long base, long length);
+
+  private static class Mapping {
+    public final long base;
+    public final long length;
+
+    public Mapping(long base, long length) {
+      this.base = base;
+      this.length = length;
+    }
+
+    protected void finalize() {
+      if (length != 0) {
+        unmap(base, length);
+      }
+    }
+  }
+}
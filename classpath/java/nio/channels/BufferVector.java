@@ -0,0 +1,78 @@
+/* Copyright (c) 2008-2015, Avian Contributors
+
+   Permission to use, copy, modify, and/or distribute this software
+   for any purpose with or without fee is hereby granted, provided
+   that the above copyright notice and this permission notice appear
+   in all copies.
+
+   There is NO WARRANTY for this software.  See license.txt for
+   details. */
+
+package java.nio.channels;
+
+import java.nio.ByteBuffer;
+
+// Describes a sequence of buffers in the form expected by the
+// scatter/gather natives.  Heap buffers are passed as their backing
+// arrays, while direct buffers have a null array and are accessed by
+// address.
+class BufferVector {
+  // the most buffers passed to a single system call (IOV_MAX and
+  // UIO_MAXIOV on Linux)
+  public static final int MaxCount = 1024;
+
+  public final ByteBuffer[] buffers;
+  public final byte[][] arrays;
+  public final int[] offsets;
+  public final int[] lengths;
+  public final int count;
+
+  public BufferVector(ByteBuffer[] src, int offset, int length) {
+    if (offset < 0 || length < 0 || offset + length > src.length) {
+      throw new IndexOutOfBoundsException();
+    }
+
+    count = Math.min(length, MaxCount);
+    buffers = new ByteBuffer[count];
+    arrays = new byte[count][];
+    offsets = new int[count];
+    lengths = new int[count];
+
+    for (int i = 0; i < count; ++i) {
+      ByteBuffer b = src[offset + i];
+      buffers[i] = b;
+      if (b.hasArray()) {
+        arrays[i] = b.array();
+        offsets[i] = b.arrayOffset() + b.position();
+      } else {
+        offsets[i] = b.position();
+      }
+      lengths[i] = b.remaining();
+    }
+  }
+
+  public long remaining() {
+    long total = 0;
+    for (int i = 0; i < count; ++i) {
+      total += lengths[i];
+    }
+    return total;
+  }
+
+  // advances the buffers past n bytes, filling or draining each in turn
+  public void advance(long n) {
+    for (int i = 0; i < count && n > 0; ++i) {
+      int c = (int) Math.min(n, lengths[i]);
+      buffers[i].position(buffers[i].position() + c);
+      n -= c;
+    }
+  }
+
+  // advances each of the first count buffers by the number of bytes
+  // the datagram natives recorded for it in lengths
+  public void advanceEach(int count) {
+    for (int i = 0; i < count; ++i) {
+      buffers[i].position(buffers[i].position() + lengths[i]);
+    }
+  }
+}
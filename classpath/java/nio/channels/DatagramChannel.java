@@ -172,6 +172,73 @@ public class DatagramChannel extends SelectableChannel
     return c;    
   }
 
+  // Sends each message in srcs to the corresponding address in
+  // targets (or to the connected address if targets is null), using a
+  // single system call where the platform allows.  Returns the number
+  // of messages sent, each of whose buffers is advanced past the
+  // bytes sent.
+  public int send(ByteBuffer[] srcs, SocketAddress[] targets, int offset,
+                  int length)
+    throws IOException
+  {
+    BufferVector v = new BufferVector(srcs, offset, length);
+    if (v.count == 0) return 0;
+
+    int[] addresses = null;
+    if (targets != null) {
+      addresses = new int[v.count * 2];
+      for (int i = 0; i < v.count; ++i) {
+        InetSocketAddress a;
+        try {
+          a = (InetSocketAddress) targets[offset + i];
+        } catch (ClassCastException e) {
+          throw new UnsupportedAddressTypeException();
+        }
+        addresses[i * 2] = a.getAddress().getRawAddress();
+        addresses[(i * 2) + 1] = a.getPort();
+      }
+    }
+
+    int c = sendBatch
+      (socket, v.buffers, v.arrays, v.offsets, v.lengths, v.count,
+       addresses);
+
+    v.advanceEach(c);
+
+    return c;
+  }
+
+  // Receives up to length messages into the buffers in dsts, one
+  // message per buffer, using a single system call where the platform
+  // allows.  If sources is not null, the sender of each message is
+  // stored at the corresponding index.  Returns the number of messages
+  // received, which is zero if none were waiting and this channel is
+  // not blocking.
+  public int receive(ByteBuffer[] dsts, SocketAddress[] sources, int offset,
+                     int length)
+    throws IOException
+  {
+    BufferVector v = new BufferVector(dsts, offset, length);
+    if (v.count == 0) return 0;
+
+    int[] addresses = new int[v.count * 2];
+
+    int c = receiveBatch
+      (socket, v.buffers, v.arrays, v.offsets, v.lengths, v.count,
+       addresses);
+
+    v.advanceEach(c);
+
+    if (sources != null) {
+      for (int i = 0; i < c; ++i) {
+        sources[offset + i] = new InetSocketAddress
+          (ipv4ToString(addresses[i * 2]), addresses[(i * 2) + 1]);
+      }
+    }
+
+    return c;
+  }
+
   private static String ipv4ToString(int address) {
     StringBuilder sb = new StringBuilder();
 
@@ -235,5 +302,15 @@ public class DatagramChannel extends SelectableChannel
                                     int length, boolean blocking,
                                     int[] address)
     throws IOException;
+  private static native int sendBatch(int socket, ByteBuffer[] buffers,
+                                      byte[][] arrays, int[] offsets,
+                                      int[] lengths, int count,
+                                      int[] addresses)
+    throws IOException;
+  private static native int receiveBatch(int socket, ByteBuffer[] buffers,
+                                         byte[][] arrays, int[] offsets,
+                                         int[] lengths, int count,
+                                         int[] addresses)
+    throws IOException;
   private static native void close(int socket);
 }
@@ -12,8 +12,11 @@ package java.nio.channels;
 
 import java.io.IOException;
 import java.nio.ByteBuffer;
+import java.nio.MappedByteBuffer;
 
 public abstract class FileChannel implements Channel {
+  // the largest buffer used when a transfer can't be done in the kernel
+  private static final int TransferBufferSize = 64 * 1024;
 
   public static enum MapMode {
     PRIVATE, READ_ONLY, READ_WRITE
@@ -32,4 +35,129 @@ public abstract class FileChannel implements Channel {
   public abstract FileChannel position(long position) throws IOException;
 
   public abstract long size() throws IOException;
+
+  // Returns the native file descriptor underlying this channel.
+  protected abstract long descriptor();
+
+  public void force(boolean metaData) throws IOException {
+    natForce(descriptor(), metaData);
+  }
+
+  public MappedByteBuffer map(MapMode mode, long position, long size)
+    throws IOException
+  {
+    if (position < 0 || size < 0 || size > Integer.MAX_VALUE) {
+      throw new IllegalArgumentException();
+    }
+
+    return natMap(descriptor(), mode.ordinal(), position, size);
+  }
+
+  public long transferTo(long position, long count,
+                         WritableByteChannel target)
+    throws IOException
+  {
+    if (position < 0 || count < 0) {
+      throw new IllegalArgumentException();
+    }
+
+    long size = size();
+    if (position >= size) return 0;
+    if (count > size - position) count = size - position;
+
+    if (target instanceof FileChannel) {
+      FileChannel c = (FileChannel) target;
+      long targetPosition = c.position();
+      long n = natTransfer
+        (descriptor(), position, c.descriptor(), targetPosition, count);
+      if (n >= 0) {
+        c.position(targetPosition + n);
+        return n;
+      }
+    } else if (target instanceof SocketChannel) {
+      long n = natTransfer
+        (descriptor(), position, ((SocketChannel) target).socketFD(), -1,
+         count);
+      if (n >= 0) return n;
+    }
+
+    ByteBuffer buffer = ByteBuffer.allocate
+      ((int) Math.min(count, TransferBufferSize));
+    long total = 0;
+    while (total < count) {
+      buffer.clear();
+      buffer.limit((int) Math.min(count - total, buffer.capacity()));
+      if (read(buffer, position + total) <= 0) break;
+
+      buffer.flip();
+      while (buffer.hasRemaining()) {
+        if (target.write(buffer) <= 0) {
+          // the target can't take any more for now
+          return total + buffer.position();
+        }
+      }
+      total += buffer.limit();
+    }
+    return total;
+  }
+
+  public long transferFrom(ReadableByteChannel src, long position,
+                           long count)
+    throws IOException
+  {
+    if (position < 0 || count < 0) {
+      throw new IllegalArgumentException();
+    }
+
+    if (src instanceof FileChannel) {
+      FileChannel c = (FileChannel) src;
+      long srcPosition = c.position();
+      long srcSize = c.size();
+      if (srcPosition >= srcSize) return 0;
+      if (count > srcSize - srcPosition) count = srcSize - srcPosition;
+
+      long n = natTransfer
+        (c.descriptor(), srcPosition, descriptor(), position, count);
+      if (n >= 0) {
+        c.position(srcPosition + n);
+        return n;
+      }
+    } else if (src instanceof SocketChannel) {
+      long n = natTransfer
+        (((SocketChannel) src).socketFD(), -1, descriptor(), position,
+         count);
+      if (n >= 0) return n;
+    }
+
+    ByteBuffer buffer = ByteBuffer.allocate
+      ((int) Math.min(count, TransferBufferSize));
+    long total = 0;
+    while (total < count) {
+      buffer.clear();
+      buffer.limit((int) Math.min(count - total, buffer.capacity()));
+      if (src.read(buffer) <= 0) break;
+
+      buffer.flip();
+      while (buffer.hasRemaining()) {
+        int w = write(buffer, position + total);
+        if (w <= 0) throw new IOException();
+        total += w;
+      }
+    }
+    return total;
+  }
+
+  private static native void natForce(long descriptor, boolean metaData)
+    throws IOException;
+
+  private static native MappedByteBuffer natMap(long descriptor, int mode,
+                                                long position, long size)
+    throws IOException;
+
+  // Transfers up to count bytes in the kernel, where a position of -1
+  // means the corresponding descriptor is a socket.  Returns -1 if
+  // this isn't possible, in which case we copy through a buffer.
+  private static native long natTransfer(long in, long inPosition, long out,
+                                         long outPosition, long count)
+    throws IOException;
 }
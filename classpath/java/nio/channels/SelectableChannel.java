@@ -38,6 +38,9 @@ public abstract class SelectableChannel implements Channel {
 
   public void close() throws IOException {
     open = false;
-    key = null;
+    if (key != null) {
+      key.selector().remove(key);
+      key = null;
+    }
   }
 }
@@ -37,7 +37,10 @@ public class SelectionKey {
   }
 
   public SelectionKey interestOps(int v) {
-    this.interestOps = v;
+    if (v != interestOps) {
+      this.interestOps = v;
+      selector.update(this);
+    }
     return this;
   }
 
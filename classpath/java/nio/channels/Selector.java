@@ -30,6 +30,10 @@ public abstract class Selector {
     keys.remove(key);
   }
 
+  void update(SelectionKey key) {
+    // ignore
+  }
+
   public Set<SelectionKey> keys() {
     return keys;
   }
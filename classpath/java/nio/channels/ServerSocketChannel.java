@@ -43,7 +43,10 @@ public class ServerSocketChannel extends SelectableChannel {
   }
 
   public void close() throws IOException {
-    channel.close();
+    if (isOpen()) {
+      super.close();
+      channel.close();
+    }
   }
 
   public SocketChannel accept() throws IOException {
@@ -18,7 +18,7 @@ import java.net.Socket;
 import java.nio.ByteBuffer;
 
 public class SocketChannel extends SelectableChannel
-  implements ReadableByteChannel, GatheringByteChannel
+  implements ScatteringByteChannel, GatheringByteChannel
 {
   public static final int InvalidSocket = -1;
 
@@ -108,6 +108,10 @@ public class SocketChannel extends SelectableChannel
     if (! isOpen()) return -1;
     if (b.remaining() == 0) return 0;
 
+    if (! b.hasArray()) {
+      return (int) read(new ByteBuffer[] { b });
+    }
+
     byte[] array = b.array();
     if (array == null) throw new NullPointerException();
 
@@ -124,6 +128,10 @@ public class SocketChannel extends SelectableChannel
     }
     if (b.remaining() == 0) return 0;
 
+    if (! b.hasArray()) {
+      return (int) write(new ByteBuffer[] { b });
+    }
+
     byte[] array = b.array();
     if (array == null) throw new NullPointerException();
 
@@ -141,14 +149,39 @@ public class SocketChannel extends SelectableChannel
   public long write(ByteBuffer[] srcs, int offset, int length)
     throws IOException
   {
-    long total = 0;
-    for (int i = offset; i < offset + length; ++i) {
-      total += write(srcs[i]);
-      if (srcs[i].hasRemaining()) {
-        return total;
-      }
+    if (! connected) {
+      natThrowWriteError(socket);
+    }
+
+    BufferVector v = new BufferVector(srcs, offset, length);
+    if (v.remaining() == 0) return 0;
+
+    long w = natWritev
+      (socket, v.buffers, v.arrays, v.offsets, v.lengths, v.count);
+    if (w > 0) {
+      v.advance(w);
+    }
+    return w;
+  }
+
+  public long read(ByteBuffer[] dsts) throws IOException {
+    return read(dsts, 0, dsts.length);
+  }
+
+  public long read(ByteBuffer[] dsts, int offset, int length)
+    throws IOException
+  {
+    if (! isOpen()) return -1;
+
+    BufferVector v = new BufferVector(dsts, offset, length);
+    if (v.remaining() == 0) return 0;
+
+    long r = natReadv
+      (socket, v.buffers, v.arrays, v.offsets, v.lengths, v.count);
+    if (r > 0) {
+      v.advance(r);
     }
-    return total;
+    return r;
   }
 
   private void closeSocket() {
@@ -209,6 +242,14 @@ public class SocketChannel extends SelectableChannel
     throws IOException;
   private static native int natWrite(int socket, byte[] buffer, int offset, int length, boolean blocking)
     throws IOException;
+  private static native long natReadv(int socket, ByteBuffer[] buffers,
+                                      byte[][] arrays, int[] offsets,
+                                      int[] lengths, int count)
+    throws IOException;
+  private static native long natWritev(int socket, ByteBuffer[] buffers,
+                                       byte[][] arrays, int[] offsets,
+                                       int[] lengths, int count)
+    throws IOException;
   private static native void natThrowWriteError(int socket) throws IOException;
   private static native void natCloseSocket(int socket);
 }
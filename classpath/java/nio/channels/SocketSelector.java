@@ -11,24 +11,106 @@
 package java.nio.channels;
 
 import java.io.IOException;
+import java.util.ArrayList;
 import java.util.Iterator;
 import java.net.Socket;
 
 class SocketSelector extends Selector {
+  // Where epoll is available, sockets stay registered with the kernel
+  // and only changes to their interest sets are passed down, so a
+  // select costs time proportional to the number of ready sockets
+  // rather than the number of registered ones.  Edge-triggered mode
+  // reports a socket only when it becomes ready again, so the caller
+  // must drain it before selecting again.
+  private static final boolean UseEpoll = natUseEpoll();
+  private static final boolean EdgeTriggered
+    = Boolean.getBoolean("avian.selector.edgeTriggered");
+
   protected volatile long state;
   protected final Object lock = new Object();
   protected boolean woken = false;
 
+  // keys indexed by socket, guarded by lock
+  private SelectionKey[] keysBySocket = new SelectionKey[64];
+  // (socket, ready ops) pairs filled in by natDoEpollSelect
+  private int[] ready = new int[2 * 64];
+  // keys removed since the last select, guarded by lock.  They're only
+  // dropped from keys at the start of the next select, which holds this
+  // selector's monitor while it iterates over them.
+  private final ArrayList<SelectionKey> cancelledKeys = new ArrayList();
+
   public SocketSelector() throws IOException {
     Socket.init();
 
-    state = natInit();
+    state = natInit(EdgeTriggered);
   }
 
   public boolean isOpen() {
     return state != 0;
   }
 
+  public void add(SelectionKey key) {
+    super.add(key);
+
+    if (UseEpoll) {
+      synchronized (lock) {
+        int socket = key.channel().socketFD();
+        if (socket >= keysBySocket.length) {
+          int length = keysBySocket.length;
+          while (socket >= length) length *= 2;
+          SelectionKey[] array = new SelectionKey[length];
+          System.arraycopy(keysBySocket, 0, array, 0, keysBySocket.length);
+          keysBySocket = array;
+        }
+        keysBySocket[socket] = key;
+
+        update(key);
+      }
+    }
+  }
+
+  public void remove(SelectionKey key) {
+    synchronized (lock) {
+      cancelledKeys.add(key);
+
+      int socket = key.channel().socketFD();
+      if (! UseEpoll) {
+        if (isOpen()) {
+          natSelectClearAll(socket, state);
+        }
+      } else if (socket < keysBySocket.length
+                 && keysBySocket[socket] == key)
+      {
+        keysBySocket[socket] = null;
+
+        if (isOpen()) {
+          try {
+            natEpollUpdate(state, socket, 0);
+          } catch (IOException e) {
+            // the socket is going away regardless
+          }
+        }
+      }
+    }
+  }
+
+  void update(SelectionKey key) {
+    if (UseEpoll) {
+      synchronized (lock) {
+        int socket = key.channel().socketFD();
+        if (isOpen() && socket < keysBySocket.length
+            && keysBySocket[socket] == key)
+        {
+          try {
+            natEpollUpdate(state, socket, key.interestOps());
+          } catch (IOException e) {
+            throw new RuntimeException(e);
+          }
+        }
+      }
+    }
+  }
+
   public Selector wakeup() {
     synchronized (lock) {
       if (isOpen() && (! woken)) {
@@ -70,10 +152,21 @@ class SocketSelector extends Selector {
       throw new ClosedSelectorException();
     }
 
-    selectedKeys.clear();
-
     if (clearWoken()) interval = -1;
 
+    synchronized (lock) {
+      for (SelectionKey key : cancelledKeys) {
+        keys.remove(key);
+      }
+      cancelledKeys.clear();
+    }
+
+    if (UseEpoll) {
+      return doEpollSelect(interval);
+    }
+
+    selectedKeys.clear();
+
     int max=0;
     for (Iterator<SelectionKey> it = keys.iterator();
          it.hasNext();)
@@ -110,6 +203,42 @@ class SocketSelector extends Selector {
     return selectedKeys.size();
   }
 
+  private int doEpollSelect(long interval) throws IOException {
+    // only the keys selected last time can have ready ops to clear
+    for (SelectionKey key : selectedKeys) {
+      key.readyOps(0);
+    }
+    selectedKeys.clear();
+
+    int count = natDoEpollSelect(state, ready, interval);
+
+    synchronized (lock) {
+      for (int i = 0; i < count; ++i) {
+        int socket = ready[i * 2];
+        SelectionKey key = socket < keysBySocket.length
+          ? keysBySocket[socket] : null;
+
+        if (key != null) {
+          int ops = ready[(i * 2) + 1] & key.interestOps();
+          if (ops != 0) {
+            key.readyOps(ops);
+            key.channel().handleReadyOps(ops);
+            selectedKeys.add(key);
+          }
+        }
+      }
+    }
+
+    if (count == ready.length / 2) {
+      // the list filled up, so make room for more next time
+      ready = new int[ready.length * 2];
+    }
+
+    clearWoken();
+
+    return selectedKeys.size();
+  }
+
   public synchronized void close() {
     synchronized (lock) {
       if (isOpen()) {
@@ -119,7 +248,8 @@ class SocketSelector extends Selector {
     }
   }
 
-  private static native long natInit();
+  private static native boolean natUseEpoll();
+  private static native long natInit(boolean edgeTriggered);
   private static native void natWakeup(long state);
   private static native void natClose(long state);
   private static native void natSelectClearAll(int socket, long state);
@@ -130,4 +260,10 @@ class SocketSelector extends Selector {
   private static native int natDoSocketSelect(long state, int max, long interval)
     throws IOException;
   private static native int natUpdateReadySet(int socket, int interest, long state);
+  private static native void natEpollUpdate(long state, int socket,
+                                            int interest)
+    throws IOException;
+  private static native int natDoEpollSelect(long state, int[] ready,
+                                             long interval)
+    throws IOException;
 }
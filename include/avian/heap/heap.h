@@ -17,9 +17,13 @@
 namespace vm {
 
 // an object must survive TenureThreshold + 2 garbage collections
-// before being copied to gen2 (must be at least 1):
+// before being copied to gen2 (must be at least 1).  The heap adjusts
+// this between 1 and MaximumTenureThreshold according to how long
+// objects tend to live, unless told to use a fixed threshold:
 const unsigned TenureThreshold = 3;
 
+const unsigned MaximumTenureThreshold = 15;
+
 const unsigned FixieTenureThreshold = TenureThreshold + 2;
 
 class Heap : public avian::util::Allocator {
@@ -47,13 +51,29 @@ class Heap : public avian::util::Allocator {
     virtual unsigned copiedSizeInWords(void*) = 0;
     virtual void copy(void*, void*) = 0;
     virtual void walk(void*, Walker*) = 0;
+    // identifies where an object was allocated, such that objects
+    // with the same site tend to live about as long, or zero if
+    // unknown.  Used to decide what to pretenure:
+    virtual uintptr_t site(void*) = 0;
   };
 
   virtual void setClient(Client* client) = 0;
   virtual void setImmortalHeap(uintptr_t* start, unsigned sizeInWords) = 0;
+  virtual void setPauseBudget(unsigned milliseconds) = 0;
+  virtual void setCompaction(bool enabled) = 0;
+  virtual void setPretenuring(bool enabled) = 0;
+  virtual void setStackTraversal(bool enabled) = 0;
+  virtual void setTenureThreshold(unsigned threshold) = 0;
+  virtual void setPauseGoal(unsigned milliseconds) = 0;
+  virtual void setOverheadGoal(unsigned percent) = 0;
+  virtual void setFreeRatio(unsigned minimumPercent,
+                            unsigned maximumPercent) = 0;
+  // must be called, if at all, before anything is allocated:
+  virtual void setHugePages(bool enabled) = 0;
   virtual unsigned remaining() = 0;
   virtual unsigned limit() = 0;
   virtual bool limitExceeded(int pendingAllocation = 0) = 0;
+  virtual unsigned incomingLimit() = 0;
   virtual void collect(CollectionType type,
                        unsigned footprint,
                        int pendingAllocation) = 0;
@@ -64,6 +84,8 @@ class Heap : public avian::util::Allocator {
   virtual void* allocateImmortalFixed(avian::util::Alloc* allocator,
                                       unsigned sizeInWords,
                                       bool objectMask) = 0;
+  virtual void* allocateLarge(unsigned sizeInWords, bool objectMask) = 0;
+  virtual unsigned largeFootprint() = 0;
   virtual void mark(void* p, unsigned offset, unsigned count) = 0;
   virtual void pad(void* p) = 0;
   virtual void* follow(void* p) = 0;
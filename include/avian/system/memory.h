@@ -32,13 +32,25 @@ class Memory {
   };
 
   static const size_t PageSize;
+  static const size_t HugePageSize;
 
-  // Allocate a contiguous range of pages.
-  static util::Slice<uint8_t> allocate(size_t sizeInBytes, Permissions perms = ReadWrite);
+  // Allocate a contiguous range of pages.  If hugePages is true, the
+  // size is rounded up to a multiple of HugePageSize and we try to
+  // back the range with huge pages, falling back to normal ones if
+  // the system won't give us any.  Free the range using the returned
+  // slice.
+  static util::Slice<uint8_t> allocate(size_t sizeInBytes,
+                                       Permissions perms = ReadWrite,
+                                       bool hugePages = false);
 
   // Free a contiguous range of pages.
   static void free(util::Slice<uint8_t> pages);
 
+  // Let the OS reclaim the physical memory behind a contiguous range
+  // of pages while keeping the range allocated.  The contents of the
+  // pages are undefined afterward.
+  static void release(util::Slice<uint8_t> pages);
+
   // TODO: In the future:
   // static void setPermissions(util::Slice<uint8_t> pages, Permissions perms);
 };
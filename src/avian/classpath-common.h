@@ -621,7 +621,8 @@ void intercept(Thread* t,
       // through the vtable.
       clone->flags() |= ACC_PRIVATE;
 
-      GcNativeIntercept* native = makeNativeIntercept(t, function, true, clone);
+      GcNativeIntercept* native
+          = makeNativeIntercept(t, function, true, false, 0, clone);
 
       PROTECT(t, native);
 
@@ -58,6 +58,8 @@
 #define LIKELY(v) v
 #define UNLIKELY(v) v
 
+#define PREFETCH(p)
+
 #define UNUSED
 
 #define NO_RETURN __declspec(noreturn)
@@ -100,6 +102,8 @@ typedef intptr_t intptr_alias_t;
 #define LIKELY(v) __builtin_expect((v) != 0, true)
 #define UNLIKELY(v) __builtin_expect((v) != 0, false)
 
+#define PREFETCH(p) __builtin_prefetch(p)
+
 #define UNUSED __attribute__((unused))
 
 #define NO_RETURN __attribute__((noreturn))
@@ -374,6 +378,21 @@ inline unsigned getBit(T* map, unsigned i)
          >> bitOf<T>(i);
 }
 
+// returns the index of the lowest set bit in v, which must not be zero
+inline unsigned lowestBit(uint32_t v)
+{
+#ifdef _MSC_VER
+  unsigned i = 0;
+  while ((v & 1) == 0) {
+    v >>= 1;
+    ++i;
+  }
+  return i;
+#else
+  return __builtin_ctz(v);
+#endif
+}
+
 // todo: the following (clearBits, setBits, and getBits) could be made
 // more efficient by operating on a word at a time instead of a bit at
 // a time:
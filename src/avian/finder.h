@@ -188,8 +188,19 @@ class Finder {
     size_t currentSize;
   };
 
+  // Provides sequential access to a resource without necessarily
+  // decompressing all of it up front.  Reading at a position before
+  // the end of the previous read is permitted but may be slow.
+  class Stream {
+   public:
+    virtual size_t length() = 0;
+    virtual size_t read(size_t position, uint8_t* dst, size_t length) = 0;
+    virtual void dispose() = 0;
+  };
+
   virtual IteratorImp* iterator() = 0;
   virtual System::Region* find(const char* name) = 0;
+  virtual Stream* open(const char* name) = 0;
   virtual System::FileType stat(const char* name,
                                 size_t* length,
                                 bool tryDirectory = false) = 0;
@@ -21,6 +21,14 @@
 #define CLASSPATH_PROPERTY "java.class.path"
 #define JAVA_HOME_PROPERTY "java.home"
 #define REENTRANT_PROPERTY "avian.reentrant"
+#define PAUSE_BUDGET_PROPERTY "avian.gc.pauseBudget"
+#define COMPACTION_PROPERTY "avian.gc.compact"
+#define PRETENURING_PROPERTY "avian.gc.pretenure"
+#define STACK_TRAVERSAL_PROPERTY "avian.gc.stackTraversal"
+#define TENURE_THRESHOLD_PROPERTY "avian.gc.tenureThreshold"
+#define PAUSE_GOAL_PROPERTY "avian.gc.pauseGoal"
+#define OVERHEAD_GOAL_PROPERTY "avian.gc.overheadGoal"
+#define HUGE_PAGES_PROPERTY "avian.hugePages"
 #define BOOTCLASSPATH_PREPEND_OPTION "bootclasspath/p"
 #define BOOTCLASSPATH_OPTION "bootclasspath"
 #define BOOTCLASSPATH_APPEND_OPTION "bootclasspath/a"
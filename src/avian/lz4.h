@@ -0,0 +1,41 @@
+/* Copyright (c) 2008-2015, Avian Contributors
+
+   Permission to use, copy, modify, and/or distribute this software
+   for any purpose with or without fee is hereby granted, provided
+   that the above copyright notice and this permission notice appear
+   in all copies.
+
+   There is NO WARRANTY for this software.  See license.txt for
+   details. */
+
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <avian/system/system.h>
+#include <avian/util/allocator.h>
+
+namespace vm {
+
+// Data is compressed as a sequence of independent blocks, each using
+// the LZ4 block format, so that blocks may be decoded in parallel.
+// The frame starts with the uncompressed size and block size (four
+// bytes each, little-endian), followed by the compressed size of each
+// block and then the blocks themselves.  A block whose compressed
+// size equals its uncompressed size is stored as is.
+
+const size_t LZ4BlockSize = 256 * 1024;
+
+uint8_t* decodeLZ4(System* s,
+                   avian::util::Alloc* a,
+                   const uint8_t* in,
+                   size_t inSize,
+                   size_t* outSize);
+
+uint8_t* encodeLZ4(avian::util::Alloc* a,
+                   const uint8_t* in,
+                   size_t inSize,
+                   size_t* outSize);
+
+}  // namespace vm
+
+#endif  // LZ4_H
@@ -146,10 +146,20 @@ const unsigned ThreadBackupHeapSizeInBytes = 2 * 1024;
 const unsigned ThreadBackupHeapSizeInWords = ThreadBackupHeapSizeInBytes
                                              / BytesPerWord;
 
-const unsigned ThreadHeapPoolSize = 64;
+// threads carve the chunks they allocate from out of a shared eden
+// sized by Heap::incomingLimit, starting with chunks this small and
+// doubling the size with each refill up to ThreadHeapSizeInBytes, so
+// threads which allocate quickly take bigger chunks:
+const unsigned MinimumThreadHeapChunkInBytes = 4 * 1024;
+const unsigned MinimumThreadHeapChunkInWords = MinimumThreadHeapChunkInBytes
+                                               / BytesPerWord;
 
-const unsigned FixedFootprintThresholdInBytes = ThreadHeapPoolSize
-                                                * ThreadHeapSizeInBytes;
+const unsigned FixedFootprintThresholdInBytes = 64 * ThreadHeapSizeInBytes;
+
+// objects bigger than a thread heap get pages of their own, and we
+// collect after allocating as many bytes of them as were live after
+// the last collection, or this much, whichever is greater:
+const unsigned LargeFootprintThresholdInBytes = 32 * 1024 * 1024;
 
 // number of zombie threads which may accumulate before we force a GC
 // to clean them up:
@@ -1014,7 +1024,8 @@ class Machine {
   enum AllocationType {
     MovableAllocation,
     FixedAllocation,
-    ImmortalAllocation
+    ImmortalAllocation,
+    LargeAllocation
   };
 
   Machine(System* system,
@@ -1057,6 +1068,7 @@ class Machine {
   unsigned liveCount;
   unsigned daemonCount;
   unsigned fixedFootprint;
+  unsigned largeFootprint;
   unsigned stackSizeInBytes;
   System::Local* localThread;
   System::Monitor* stateLock;
@@ -1081,8 +1093,12 @@ class Machine {
   bool alive;
   JavaVMVTable javaVMVTable;
   JNIEnvVTable jniEnvVTable;
-  uintptr_t* heapPool[ThreadHeapPoolSize];
-  unsigned heapPoolIndex;
+  uintptr_t* eden;
+  uintptr_t* spareEden;
+  System::Runnable* edenZeroer;
+  unsigned edenLimit;
+  unsigned edenCapacity;
+  uint32_t edenPosition;
   size_t bootimageSize;
 };
 
@@ -1343,13 +1359,14 @@ class Thread {
   Thread* child;
   Thread* waitNext;
   State state;
-  unsigned criticalLevel;
   System::Thread* systemThread;
   System::Monitor* lock;
   GcThread* javaThread;
   GcThrowable* exception;
   unsigned heapIndex;
   unsigned heapOffset;
+  unsigned heapCapacity;
+  unsigned heapChunkSize;
   Protector* protector;
   ClassInitStack* classInitStack;
   LibraryLoadStack* libraryLoadStack;
@@ -1617,7 +1634,7 @@ inline Aborter* getAborter(Thread* t)
 inline bool ensure(Thread* t, unsigned sizeInBytes)
 {
   if (t->heapIndex + ceilingDivide(sizeInBytes, BytesPerWord)
-      > ThreadHeapSizeInWords) {
+      > t->heapCapacity) {
     if (sizeInBytes <= ThreadBackupHeapSizeInBytes) {
       expect(t, (t->getFlags() & Thread::UseBackupHeapFlag) == 0);
 
@@ -1644,7 +1661,7 @@ inline object allocateSmall(Thread* t, unsigned sizeInBytes)
 {
   assertT(t,
           t->heapIndex + ceilingDivide(sizeInBytes, BytesPerWord)
-          <= ThreadHeapSizeInWords);
+          <= t->heapCapacity);
 
   object o = reinterpret_cast<object>(t->heap + t->heapIndex);
   t->heapIndex += ceilingDivide(sizeInBytes, BytesPerWord);
@@ -1656,10 +1673,9 @@ inline object allocate(Thread* t, unsigned sizeInBytes, bool objectMask)
   stress(t);
 
   if (UNLIKELY(t->heapIndex + ceilingDivide(sizeInBytes, BytesPerWord)
-               > ThreadHeapSizeInWords or t->m->exclusive)) {
+               > t->heapCapacity or t->m->exclusive)) {
     return allocate2(t, sizeInBytes, objectMask);
   } else {
-    assertT(t, t->criticalLevel == 0);
     return allocateSmall(t, sizeInBytes);
   }
 }
@@ -3728,7 +3744,7 @@ inline void registerNative(Thread* t, GcMethod* method, void* function)
 
   expect(t, method->flags() & ACC_NATIVE);
 
-  GcNative* native = makeNative(t, function, false);
+  GcNative* native = makeNative(t, function, false, false, 0);
   PROTECT(t, native);
 
   GcMethodRuntimeData* runtimeData = getMethodRuntimeData(t, method);
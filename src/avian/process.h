@@ -54,6 +54,8 @@ inline bool isSpecialMethod(Thread* t, GcMethod* method, GcClass* class_)
 
 void resolveNative(Thread* t, GcMethod* method);
 
+void getNativeTypes(Thread* t, GcMethod* method, uint8_t* types);
+
 int findLineNumber(Thread* t, GcMethod* method, unsigned ip);
 
 }  // namespace vm
@@ -173,6 +173,16 @@ class Processor {
                              OffsetResolver* resolver,
                              Machine* hostVM) = 0;
 
+  virtual void compileMethods(Thread* t,
+                              Zone** zones,
+                              unsigned threadCount,
+                              GcTriple** constants,
+                              GcTriple** calls,
+                              avian::codegen::DelayedPromise** addresses,
+                              GcArray* methods,
+                              OffsetResolver* resolver,
+                              Machine* hostVM) = 0;
+
   virtual void visitRoots(Thread* t, HeapWalker* w) = 0;
 
   virtual void normalizeVirtualThunks(Thread* t) = 0;
@@ -234,7 +244,8 @@ class Processor {
 Processor* makeProcessor(System* system,
                          avian::util::Allocator* allocator,
                          const char* crashDumpDirectory,
-                         bool useNativeFeatures);
+                         bool useNativeFeatures,
+                         bool hugePages);
 
 }  // namespace vm
 
@@ -389,15 +389,12 @@ extern "C" AVIAN_EXPORT int64_t JNICALL
     THREAD_RUNTIME_ARRAY(t, char, p, path->length(t) + 1);
     stringChars(t, path, RUNTIME_ARRAY_BODY(p));
 
-    System::Region* r = t->m->bootFinder->find(RUNTIME_ARRAY_BODY(p));
-    if (r == 0) {
-      r = t->m->appFinder->find(RUNTIME_ARRAY_BODY(p));
-    }
-
-    if (r) {
-      jint rSize = r->length();
-      r->dispose();
-      return rSize;
+    size_t length;
+    if (t->m->bootFinder->stat(RUNTIME_ARRAY_BODY(p), &length)
+            == System::TypeFile
+        or t->m->appFinder->stat(RUNTIME_ARRAY_BODY(p), &length)
+           == System::TypeFile) {
+      return length;
     }
   }
   return -1;
@@ -415,12 +412,12 @@ extern "C" AVIAN_EXPORT int64_t JNICALL
     THREAD_RUNTIME_ARRAY(t, char, p, path->length(t) + 1);
     stringChars(t, path, RUNTIME_ARRAY_BODY(p));
 
-    System::Region* r = t->m->bootFinder->find(RUNTIME_ARRAY_BODY(p));
-    if (r == 0) {
-      r = t->m->appFinder->find(RUNTIME_ARRAY_BODY(p));
+    Finder::Stream* s = t->m->bootFinder->open(RUNTIME_ARRAY_BODY(p));
+    if (s == 0) {
+      s = t->m->appFinder->open(RUNTIME_ARRAY_BODY(p));
     }
 
-    return reinterpret_cast<int64_t>(r);
+    return reinterpret_cast<int64_t>(s);
   } else {
     throwNew(t, GcNullPointerException::Type);
   }
@@ -436,8 +433,8 @@ extern "C" AVIAN_EXPORT int64_t JNICALL
   memcpy(&peer, arguments, 8);
   int32_t position = arguments[2];
 
-  System::Region* region = reinterpret_cast<System::Region*>(peer);
-  return static_cast<jint>(region->length()) - position;
+  Finder::Stream* stream = reinterpret_cast<Finder::Stream*>(peer);
+  return static_cast<jint>(stream->length()) - position;
 }
 
 extern "C" AVIAN_EXPORT int64_t JNICALL
@@ -450,11 +447,12 @@ extern "C" AVIAN_EXPORT int64_t JNICALL
   memcpy(&peer, arguments, 8);
   int32_t position = arguments[2];
 
-  System::Region* region = reinterpret_cast<System::Region*>(peer);
-  if (position >= static_cast<jint>(region->length())) {
+  Finder::Stream* stream = reinterpret_cast<Finder::Stream*>(peer);
+  uint8_t c;
+  if (stream->read(position, &c, 1) == 0) {
     return -1;
   } else {
-    return region->start()[position];
+    return c;
   }
 }
 
@@ -475,15 +473,16 @@ extern "C" AVIAN_EXPORT int64_t JNICALL
   if (length == 0)
     return 0;
 
-  System::Region* region = reinterpret_cast<System::Region*>(peer);
-  if (length > static_cast<jint>(region->length()) - position) {
-    length = static_cast<jint>(region->length()) - position;
+  Finder::Stream* stream = reinterpret_cast<Finder::Stream*>(peer);
+  if (length > static_cast<jint>(stream->length()) - position) {
+    length = static_cast<jint>(stream->length()) - position;
   }
   if (length <= 0) {
     return -1;
   } else {
-    memcpy(&buffer->body()[offset], region->start() + position, length);
-    return length;
+    return stream->read(position,
+                        reinterpret_cast<uint8_t*>(&buffer->body()[offset]),
+                        length);
   }
 }
 
@@ -495,7 +494,7 @@ extern "C" AVIAN_EXPORT void JNICALL
 {
   int64_t peer;
   memcpy(&peer, arguments, 8);
-  reinterpret_cast<System::Region*>(peer)->dispose();
+  reinterpret_cast<Finder::Stream*>(peer)->dispose();
 }
 
 extern "C" AVIAN_EXPORT void JNICALL
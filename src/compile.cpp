@@ -2413,6 +2413,17 @@ void compile(MyThread* t,
              BootContext* bootContext,
              GcMethod* method);
 
+void compile(MyThread* t,
+             FixedAllocator* allocator,
+             Zone** zones,
+             unsigned threadCount,
+             GcTriple** constants,
+             GcTriple** calls,
+             avian::codegen::DelayedPromise** addresses,
+             GcArray* methods,
+             OffsetResolver* resolver,
+             JavaVM* hostVM);
+
 GcMethod* resolveMethod(Thread* t, GcPair* pair)
 {
   GcReference* reference = cast<GcReference>(t, pair->second());
@@ -3145,6 +3156,10 @@ void logCompile(MyThread* t,
                 const char* name,
                 const char* spec);
 
+FILE* profileLog = 0;
+
+void logProfile(MyThread* t, GcMethod* method);
+
 unsigned simpleFrameMapTableSize(MyThread* t, GcMethod* method, GcIntArray* map)
 {
   int size = frameMapSizeInBits(t, method);
@@ -7145,6 +7160,16 @@ GcIntArray* makeSimpleFrameMapTable(MyThread* t,
 
 void insertCallNode(MyThread* t, GcCallNode* node);
 
+// Runs register allocation and instruction selection over the
+// intermediate code produced by compile(MyThread*, Context*).  This
+// touches neither the heap nor any state shared with other contexts,
+// so it may be run for several contexts at once.
+void assemble(Context* context, uintptr_t stackOverflowHandler)
+{
+  context->compiler->compile(context->leaf ? 0 : stackOverflowHandler,
+                             TARGET_THREAD_STACKLIMIT);
+}
+
 void finish(MyThread* t, FixedAllocator* allocator, Context* context)
 {
   avian::codegen::Compiler* c = context->compiler;
@@ -7171,14 +7196,6 @@ void finish(MyThread* t, FixedAllocator* allocator, Context* context)
     trap();
   }
 
-  // todo: this is a CPU-intensive operation, so consider doing it
-  // earlier before we've acquired the global class lock to improve
-  // parallelism (the downside being that it may end up being a waste
-  // of cycles if another thread compiles the same method in parallel,
-  // which might be mitigated by fine-grained, per-method locking):
-  c->compile(context->leaf ? 0 : stackOverflowThunk(t),
-             TARGET_THREAD_STACKLIMIT);
-
   // we must acquire the class lock here at the latest
 
   unsigned codeSize = c->resolve(allocator->memory.begin() + allocator->offset);
@@ -7300,6 +7317,8 @@ void finish(MyThread* t, FixedAllocator* allocator, Context* context)
       reinterpret_cast<const char*>(context->method->name()->body().begin()),
       reinterpret_cast<const char*>(context->method->spec()->body().begin()));
 
+  logProfile(t, context->method);
+
   // for debugging:
   if (false
       and ::strcmp(reinterpret_cast<const char*>(
@@ -7600,10 +7619,9 @@ uint64_t invokeNativeSlow(MyThread* t, GcMethod* method, void* function)
   THREAD_RUNTIME_ARRAY(t, uintptr_t, args, footprint);
   unsigned argOffset = 0;
   THREAD_RUNTIME_ARRAY(t, uint8_t, types, count);
-  unsigned typeOffset = 0;
+  getNativeTypes(t, method, RUNTIME_ARRAY_BODY(types));
 
   RUNTIME_ARRAY_BODY(args)[argOffset++] = reinterpret_cast<uintptr_t>(t);
-  RUNTIME_ARRAY_BODY(types)[typeOffset++] = POINTER_TYPE;
 
   uintptr_t* sp = static_cast<uintptr_t*>(t->stack) + t->arch->frameFooterSize()
                   + t->arch->frameReturnAddressSize();
@@ -7618,16 +7636,9 @@ uint64_t invokeNativeSlow(MyThread* t, GcMethod* method, void* function)
   } else {
     RUNTIME_ARRAY_BODY(args)[argOffset++] = reinterpret_cast<uintptr_t>(sp++);
   }
-  RUNTIME_ARRAY_BODY(types)[typeOffset++] = POINTER_TYPE;
-
-  MethodSpecIterator it(
-      t, reinterpret_cast<const char*>(method->spec()->body().begin()));
-
-  while (it.hasNext()) {
-    unsigned type = RUNTIME_ARRAY_BODY(types)[typeOffset++]
-        = fieldType(t, fieldCode(t, *it.next()));
 
-    switch (type) {
+  for (unsigned i = 2; i < count; ++i) {
+    switch (RUNTIME_ARRAY_BODY(types)[i]) {
     case INT8_TYPE:
     case INT16_TYPE:
     case INT32_TYPE:
@@ -7757,11 +7768,112 @@ uint64_t invokeNativeSlow(MyThread* t, GcMethod* method, void* function)
   return result;
 }
 
+uint64_t invokeNativeCritical(MyThread* t, GcMethod* method, void* function)
+{
+  PROTECT(t, method);
+
+  unsigned parameterCount = method->parameterCount();
+
+  THREAD_RUNTIME_ARRAY(t, uint8_t, parameterTypes, parameterCount + 2);
+  getNativeTypes(t, method, RUNTIME_ARRAY_BODY(parameterTypes));
+
+  // each parameter occupies at most two words and two type slots,
+  // since arrays are passed as a length followed by a pointer:
+  THREAD_RUNTIME_ARRAY(t, uintptr_t, args, (parameterCount * 2) + 1);
+  unsigned argOffset = 0;
+  THREAD_RUNTIME_ARRAY(t, uint8_t, types, (parameterCount * 2) + 1);
+  unsigned typeOffset = 0;
+
+  uintptr_t* sp = static_cast<uintptr_t*>(t->stack) + t->arch->frameFooterSize()
+                  + t->arch->frameReturnAddressSize();
+
+  for (unsigned i = 2; i < parameterCount + 2; ++i) {
+    unsigned type = RUNTIME_ARRAY_BODY(parameterTypes)[i];
+    switch (type) {
+    case INT8_TYPE:
+    case INT16_TYPE:
+    case INT32_TYPE:
+    case FLOAT_TYPE:
+      RUNTIME_ARRAY_BODY(types)[typeOffset++] = type;
+      RUNTIME_ARRAY_BODY(args)[argOffset++] = *(sp++);
+      break;
+
+    case INT64_TYPE:
+    case DOUBLE_TYPE: {
+      RUNTIME_ARRAY_BODY(types)[typeOffset++] = type;
+      memcpy(RUNTIME_ARRAY_BODY(args) + argOffset, sp, 8);
+      argOffset += (8 / BytesPerWord);
+      sp += 2;
+    } break;
+
+    case POINTER_TYPE: {
+      uintptr_t* array = reinterpret_cast<uintptr_t*>(*(sp++));
+      RUNTIME_ARRAY_BODY(types)[typeOffset++] = INT32_TYPE;
+      RUNTIME_ARRAY_BODY(args)[argOffset++] = array ? array[1] : 0;
+      RUNTIME_ARRAY_BODY(types)[typeOffset++] = POINTER_TYPE;
+      RUNTIME_ARRAY_BODY(args)[argOffset++]
+          = array ? reinterpret_cast<uintptr_t>(array + 2) : 0;
+    } break;
+
+    default:
+      abort(t);
+    }
+  }
+
+  unsigned returnCode = method->returnCode();
+
+  if (DebugNatives) {
+    fprintf(stderr,
+            "invoke critical native method %s.%s\n",
+            method->class_()->name()->body().begin(),
+            method->name()->body().begin());
+  }
+
+  // We remain in the active state for the duration of the call, which
+  // keeps the garbage collector from moving the arrays out from under
+  // the native code.  Critical natives may not call back into the VM,
+  // so there is no need for local references or exception checks.
+  uint64_t result = vm::dynamicCall(function,
+                                    RUNTIME_ARRAY_BODY(args),
+                                    RUNTIME_ARRAY_BODY(types),
+                                    typeOffset,
+                                    argOffset * BytesPerWord,
+                                    fieldType(t, returnCode));
+
+  switch (returnCode) {
+  case ByteField:
+  case BooleanField:
+    return static_cast<int8_t>(result);
+
+  case CharField:
+    return static_cast<uint16_t>(result);
+
+  case ShortField:
+    return static_cast<int16_t>(result);
+
+  case FloatField:
+  case IntField:
+    return static_cast<int32_t>(result);
+
+  case LongField:
+  case DoubleField:
+    return result;
+
+  case VoidField:
+    return 0;
+
+  default:
+    abort(t);
+  }
+}
+
 uint64_t invokeNative2(MyThread* t, GcMethod* method)
 {
   GcNative* native = getMethodRuntimeData(t, method)->native();
   if (native->fast()) {
     return invokeNativeFast(t, method, native->function());
+  } else if (native->critical()) {
+    return invokeNativeCritical(t, method, native->function());
   } else {
     return invokeNativeSlow(t, method, native->function());
   }
@@ -8674,6 +8786,10 @@ class SignalHandler : public SignalRegistrar::Handler {
       fflush(compileLog);
     }
 
+    if (profileLog) {
+      fflush(profileLog);
+    }
+
     return false;
   }
 
@@ -8769,7 +8885,8 @@ class MyProcessor : public Processor {
   MyProcessor(System* s,
               Allocator* allocator,
               const char* crashDumpDirectory,
-              bool useNativeFeatures)
+              bool useNativeFeatures,
+              bool hugePages)
       : s(s),
         allocator(allocator),
         roots(0),
@@ -8787,6 +8904,7 @@ class MyProcessor : public Processor {
         callTableSize(0),
         dynamicIndex(0),
         useNativeFeatures(useNativeFeatures),
+        hugePages(hugePages),
         compilationHandlers(0),
         dynamicTable(0),
         dynamicTableSize(0)
@@ -9393,6 +9511,28 @@ class MyProcessor : public Processor {
     *addresses = bootContext.addresses;
   }
 
+  virtual void compileMethods(Thread* vmt,
+                              Zone** zones,
+                              unsigned threadCount,
+                              GcTriple** constants,
+                              GcTriple** calls,
+                              avian::codegen::DelayedPromise** addresses,
+                              GcArray* methods,
+                              OffsetResolver* resolver,
+                              JavaVM* hostVM)
+  {
+    compile(static_cast<MyThread*>(vmt),
+            &codeAllocator,
+            zones,
+            threadCount,
+            constants,
+            calls,
+            addresses,
+            methods,
+            resolver,
+            hostVM);
+  }
+
   virtual void visitRoots(Thread* t, HeapWalker* w)
   {
     bootImage->methodTree = w->visitRoot(compileRoots(t)->methodTree());
@@ -9442,7 +9582,8 @@ class MyProcessor : public Processor {
 #ifndef AVIAN_AOT_ONLY
     if (codeAllocator.memory.begin() == 0) {
       codeAllocator.memory = Memory::allocate(ExecutableAreaSizeInBytes,
-                                              Memory::ReadWriteExecute);
+                                              Memory::ReadWriteExecute,
+                                              hugePages);
 
       expect(t, codeAllocator.memory.begin());
     }
@@ -9556,6 +9697,7 @@ class MyProcessor : public Processor {
   unsigned callTableSize;
   unsigned dynamicIndex;
   bool useNativeFeatures;
+  bool hugePages;
   void* thunkTable[dummyIndex + 1];
   CompilationHandlerList* compilationHandlers;
   void** dynamicTable;
@@ -9636,6 +9778,33 @@ void logCompile(MyThread* t,
   }
 }
 
+// Since methods are compiled lazily on first call, the order in
+// which we compile them is the order in which they are first
+// executed.  We record that order so that the bootimage generator
+// can use it to lay out the code image (see -method-order).  Note
+// that methods already present in a boot image are never compiled at
+// runtime, so profiles should be recorded using a JIT-only build.
+void logProfile(MyThread* t, GcMethod* method)
+{
+  static bool open = false;
+  if (not open) {
+    open = true;
+    const char* path = findProperty(t, "avian.jit.profile");
+    if (path) {
+      profileLog = vm::fopen(path, "wb");
+    }
+  }
+
+  if (profileLog) {
+    fprintf(profileLog,
+            "%s.%s%s\n",
+            reinterpret_cast<const char*>(
+                method->class_()->name()->body().begin()),
+            reinterpret_cast<const char*>(method->name()->body().begin()),
+            reinterpret_cast<const char*>(method->spec()->body().begin()));
+  }
+}
+
 void* compileMethod2(MyThread* t, void* ip)
 {
   GcCallNode* node = findCallNode(t, ip);
@@ -10628,72 +10797,31 @@ uintptr_t virtualThunk(MyThread* t, unsigned index)
   return oldArray->body()[index * 2];
 }
 
-void compile(MyThread* t,
-             FixedAllocator* allocator UNUSED,
-             BootContext* bootContext,
-             GcMethod* method)
+#ifndef AVIAN_AOT_ONLY
+void resolveHandlerTypes(MyThread* t, GcMethod* method)
 {
-  PROTECT(t, method);
-
-  if (bootContext == 0 and method->flags() & ACC_STATIC) {
-    initClass(t, method->class_());
-  }
-
-  if (methodAddress(t, method) != defaultThunk(t)) {
-    return;
-  }
-
-  assertT(t, (method->flags() & ACC_NATIVE) == 0);
-
-#ifdef AVIAN_AOT_ONLY
-  abort(t);
-#else
-
-  // We must avoid acquiring any locks until after the first pass of
-  // compilation, since this pass may trigger classloading operations
-  // involving application classloaders and thus the potential for
-  // deadlock.  To make this safe, we use a private clone of the
-  // method so that we won't be confused if another thread updates the
-  // original while we're working.
-
-  GcMethod* clone = methodClone(t, method);
-
-  loadMemoryBarrier();
-
-  if (methodAddress(t, method) != defaultThunk(t)) {
-    return;
-  }
-
-  PROTECT(t, clone);
-
-  Context context(t, bootContext, clone);
-  compile(t, &context);
+  GcExceptionHandlerTable* ehTable = cast<GcExceptionHandlerTable>(
+      t, method->code()->exceptionHandlerTable());
 
-  {
-    GcExceptionHandlerTable* ehTable = cast<GcExceptionHandlerTable>(
-        t, clone->code()->exceptionHandlerTable());
-
-    if (ehTable) {
-      PROTECT(t, ehTable);
+  if (ehTable) {
+    PROTECT(t, method);
+    PROTECT(t, ehTable);
 
-      // resolve all exception handler catch types before we acquire
-      // the class lock:
-      for (unsigned i = 0; i < ehTable->length(); ++i) {
-        uint64_t handler = ehTable->body()[i];
-        if (exceptionHandlerCatchType(handler)) {
-          resolveClassInPool(t, clone, exceptionHandlerCatchType(handler) - 1);
-        }
+    for (unsigned i = 0; i < ehTable->length(); ++i) {
+      uint64_t handler = ehTable->body()[i];
+      if (exceptionHandlerCatchType(handler)) {
+        resolveClassInPool(t, method, exceptionHandlerCatchType(handler) - 1);
       }
     }
   }
+}
 
-  ACQUIRE(t, t->m->classLock);
-
-  if (methodAddress(t, method) != defaultThunk(t)) {
-    return;
-  }
+void install(MyThread* t, Context* context, GcMethod* method)
+{
+  PROTECT(t, method);
 
-  finish(t, allocator, &context);
+  GcMethod* clone = context->method;
+  PROTECT(t, clone);
 
   if (DebugMethodTree) {
     fprintf(stderr,
@@ -10712,7 +10840,7 @@ void compile(MyThread* t,
   // original to save memory.
 
   GcTreeNode* newTree = treeInsert(t,
-                                   &(context.zone),
+                                   &(context->zone),
                                    compileRoots(t)->methodTree(),
                                    methodCompiled(t, clone),
                                    clone,
@@ -10733,7 +10861,7 @@ void compile(MyThread* t,
   // we've compiled the method and inserted it into the tree without
   // error, so we ensure that the executable area not be deallocated
   // when we dispose of the context:
-  context.executableAllocator = 0;
+  context->executableAllocator = 0;
 
   treeUpdate(t,
              compileRoots(t)->methodTree(),
@@ -10741,6 +10869,233 @@ void compile(MyThread* t,
              method,
              compileRoots(t)->methodTreeSentinal(),
              compareIpToMethodBounds);
+}
+
+class AssembleTask : public System::Runnable {
+ public:
+  AssembleTask(Context** contexts,
+               unsigned count,
+               unsigned start,
+               unsigned stride,
+               uintptr_t stackOverflowHandler)
+      : contexts(contexts),
+        count(count),
+        start(start),
+        stride(stride),
+        stackOverflowHandler(stackOverflowHandler),
+        thread(0)
+  {
+  }
+
+  virtual void attach(System::Thread* thread)
+  {
+    this->thread = thread;
+  }
+
+  virtual void run()
+  {
+    for (unsigned i = start; i < count; i += stride) {
+      if (contexts[i]) {
+        assemble(contexts[i], stackOverflowHandler);
+      }
+    }
+  }
+
+  virtual bool interrupted()
+  {
+    return false;
+  }
+
+  virtual void setInterrupted(bool)
+  {
+  }
+
+  Context** contexts;
+  unsigned count;
+  unsigned start;
+  unsigned stride;
+  uintptr_t stackOverflowHandler;
+  System::Thread* thread;
+};
+#endif // not AVIAN_AOT_ONLY
+
+// Compiles a batch of methods for a boot image using up to
+// threadCount threads.  The front end of each method runs on this
+// thread, in order, since it may load classes and allocate on the
+// heap.  The back end (see assemble) is then spread across the
+// threads, each taking every threadCount-th method and allocating
+// only from its own zone.  Finally, the results are placed in the
+// code image in order, so the image does not depend on the number of
+// threads used.
+void compile(MyThread* t,
+             FixedAllocator* allocator UNUSED,
+             Zone** zones UNUSED,
+             unsigned threadCount UNUSED,
+             GcTriple** constants UNUSED,
+             GcTriple** calls UNUSED,
+             avian::codegen::DelayedPromise** addresses UNUSED,
+             GcArray* methods,
+             OffsetResolver* resolver UNUSED,
+             JavaVM* hostVM UNUSED)
+{
+  PROTECT(t, methods);
+
+#ifdef AVIAN_AOT_ONLY
+  abort(t);
+#else
+  unsigned count = methods->length();
+
+  THREAD_RUNTIME_ARRAY(t, BootContext*, bootContexts, count);
+  THREAD_RUNTIME_ARRAY(t, Context*, contexts, count);
+
+  // Each context registers itself as a GC root and a resource on
+  // creation, so we must dispose of them in reverse order:
+  for (unsigned i = 0; i < count; ++i) {
+    BootContext* bc = new (t->m->heap->allocate(sizeof(BootContext)))
+        BootContext(t,
+                    *constants,
+                    *calls,
+                    *addresses,
+                    zones[i % threadCount],
+                    resolver,
+                    hostVM);
+
+    RUNTIME_ARRAY_BODY(bootContexts)[i] = bc;
+    RUNTIME_ARRAY_BODY(contexts)[i] = 0;
+
+    GcMethod* method = cast<GcMethod>(t, methods->body()[i]);
+    if (methodAddress(t, method) == defaultThunk(t)) {
+      // no need to protect the clone here, since the context will do
+      // that for us before we allocate anything else:
+      Context* context = new (t->m->heap->allocate(sizeof(Context)))
+          Context(t, bc, methodClone(t, method));
+
+      RUNTIME_ARRAY_BODY(contexts)[i] = context;
+
+      compile(t, context);
+
+      resolveHandlerTypes(t, context->method);
+    }
+
+    *constants = bc->constants;
+    *calls = bc->calls;
+    *addresses = bc->addresses;
+  }
+
+  AssembleTask** tasks = static_cast<AssembleTask**>(
+      t->m->heap->allocate(threadCount * sizeof(AssembleTask*)));
+
+  for (unsigned i = 0; i < threadCount; ++i) {
+    tasks[i] = new (t->m->heap->allocate(sizeof(AssembleTask)))
+        AssembleTask(RUNTIME_ARRAY_BODY(contexts),
+                     count,
+                     i,
+                     threadCount,
+                     stackOverflowThunk(t));
+
+    if (i) {
+      expect(t, t->m->system->success(t->m->system->start(tasks[i])));
+    }
+  }
+
+  tasks[0]->run();
+
+  for (unsigned i = 0; i < threadCount; ++i) {
+    if (i) {
+      tasks[i]->thread->join();
+      tasks[i]->thread->dispose();
+    }
+    t->m->heap->free(tasks[i], sizeof(AssembleTask));
+  }
+
+  t->m->heap->free(tasks, threadCount * sizeof(AssembleTask*));
+
+  for (unsigned i = 0; i < count; ++i) {
+    Context* context = RUNTIME_ARRAY_BODY(contexts)[i];
+    if (context) {
+      ACQUIRE(t, t->m->classLock);
+
+      finish(t, allocator, context);
+
+      install(t, context, cast<GcMethod>(t, methods->body()[i]));
+    }
+  }
+
+  for (unsigned i = count; i > 0; --i) {
+    Context* context = RUNTIME_ARRAY_BODY(contexts)[i - 1];
+    if (context) {
+      context->~Context();
+      t->m->heap->free(context, sizeof(Context));
+    }
+
+    BootContext* bc = RUNTIME_ARRAY_BODY(bootContexts)[i - 1];
+    bc->~BootContext();
+    t->m->heap->free(bc, sizeof(BootContext));
+  }
+#endif // not AVIAN_AOT_ONLY
+}
+
+void compile(MyThread* t,
+             FixedAllocator* allocator UNUSED,
+             BootContext* bootContext,
+             GcMethod* method)
+{
+  PROTECT(t, method);
+
+  if (bootContext == 0 and method->flags() & ACC_STATIC) {
+    initClass(t, method->class_());
+  }
+
+  if (methodAddress(t, method) != defaultThunk(t)) {
+    return;
+  }
+
+  assertT(t, (method->flags() & ACC_NATIVE) == 0);
+
+#ifdef AVIAN_AOT_ONLY
+  abort(t);
+#else
+
+  // We must avoid acquiring any locks until after the first pass of
+  // compilation, since this pass may trigger classloading operations
+  // involving application classloaders and thus the potential for
+  // deadlock.  To make this safe, we use a private clone of the
+  // method so that we won't be confused if another thread updates the
+  // original while we're working.
+
+  GcMethod* clone = methodClone(t, method);
+
+  loadMemoryBarrier();
+
+  if (methodAddress(t, method) != defaultThunk(t)) {
+    return;
+  }
+
+  PROTECT(t, clone);
+
+  Context context(t, bootContext, clone);
+  compile(t, &context);
+
+  // resolve all exception handler catch types before we acquire the
+  // class lock:
+  resolveHandlerTypes(t, clone);
+
+  ACQUIRE(t, t->m->classLock);
+
+  if (methodAddress(t, method) != defaultThunk(t)) {
+    return;
+  }
+
+  // todo: this is a CPU-intensive operation, so consider doing it
+  // earlier before we've acquired the global class lock to improve
+  // parallelism (the downside being that it may end up being a waste
+  // of cycles if another thread compiles the same method in parallel,
+  // which might be mitigated by fine-grained, per-method locking):
+  assemble(&context, stackOverflowThunk(t));
+
+  finish(t, allocator, &context);
+
+  install(t, &context, method);
 #endif // not AVIAN_AOT_ONLY
 }
 
@@ -10768,11 +11123,15 @@ namespace vm {
 Processor* makeProcessor(System* system,
                          Allocator* allocator,
                          const char* crashDumpDirectory,
-                         bool useNativeFeatures)
+                         bool useNativeFeatures,
+                         bool hugePages)
 {
   return new (allocator->allocate(sizeof(local::MyProcessor)))
-      local::MyProcessor(
-          system, allocator, crashDumpDirectory, useNativeFeatures);
+      local::MyProcessor(system,
+                         allocator,
+                         crashDumpDirectory,
+                         useNativeFeatures,
+                         hugePages);
 }
 
 }  // namespace vm
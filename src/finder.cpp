@@ -16,8 +16,10 @@
 #include <avian/util/tokenizer.h>
 
 #include "avian/zlib-custom.h"
+#include "avian/arch.h"
 #include "avian/finder.h"
 #include "avian/lzma.h"
+#include "avian/lz4.h"
 #include "avian/append.h"
 
 using namespace vm;
@@ -28,6 +30,15 @@ namespace {
 const bool DebugFind = false;
 const bool DebugStat = false;
 
+// Deflated jar entries at least this large are neither cached nor
+// inflated all at once when opened as a stream:
+const size_t LargeEntrySize = 64 * 1024;
+
+// Maximum number of bytes of inflated jar entries kept by each finder:
+const size_t CacheCapacity = 1024 * 1024;
+
+class JarIndex;
+
 class Element {
  public:
   class Iterator {
@@ -36,10 +47,15 @@ class Element {
     virtual void dispose() = 0;
   };
 
-  Element() : next(0)
+  Element() : next(0), indexed(false)
   {
   }
 
+  virtual JarIndex* jarIndex()
+  {
+    return 0;
+  }
+
   virtual Iterator* iterator() = 0;
   virtual System::Region* find(const char* name) = 0;
   virtual System::FileType stat(const char* name,
@@ -50,6 +66,7 @@ class Element {
   virtual void dispose() = 0;
 
   Element* next;
+  bool indexed;
 };
 
 class DirectoryElement : public Element {
@@ -263,6 +280,30 @@ class DataRegion : public System::Region {
   uint8_t data[0];
 };
 
+void inflateEntry(System* s,
+                  const uint8_t* in,
+                  size_t inSize,
+                  uint8_t* out,
+                  size_t outSize)
+{
+  z_stream zStream;
+  memset(&zStream, 0, sizeof(z_stream));
+
+  zStream.next_in = const_cast<uint8_t*>(in);
+  zStream.avail_in = inSize;
+  zStream.next_out = out;
+  zStream.avail_out = outSize;
+
+  // -15 means max window size and raw deflate (no zlib wrapper)
+  int r = inflateInit2(&zStream, -15);
+  expect(s, r == Z_OK);
+
+  r = inflate(&zStream, Z_FINISH);
+  expect(s, r == Z_STREAM_END);
+
+  inflateEnd(&zStream);
+}
+
 class JarIndex {
  public:
   enum CompressionMethod { Stored = 0, Deflated = 8 };
@@ -358,49 +399,37 @@ class JarIndex {
   System::Region* find(const char* name, const uint8_t* start)
   {
     List<Entry>* n = findNode(name);
-    if (n) {
-      const uint8_t* p = n->item.entry;
-      switch (compressionMethod(p)) {
-      case Stored: {
-        return new (allocator->allocate(sizeof(PointerRegion)))
-            PointerRegion(s,
-                          allocator,
-                          fileData(start + localHeaderOffset(p)),
-                          compressedSize(p));
-      } break;
-
-      case Deflated: {
-        DataRegion* region = new (
-            allocator->allocate(sizeof(DataRegion) + uncompressedSize(p)))
-            DataRegion(s, allocator, uncompressedSize(p));
-
-        z_stream zStream;
-        memset(&zStream, 0, sizeof(z_stream));
-
-        zStream.next_in
-            = const_cast<uint8_t*>(fileData(start + localHeaderOffset(p)));
-        zStream.avail_in = compressedSize(p);
-        zStream.next_out = region->data;
-        zStream.avail_out = region->length();
+    return n ? extract(n->item.entry, start) : 0;
+  }
 
-        // -15 means max window size and raw deflate (no zlib wrapper)
-        int r = inflateInit2(&zStream, -15);
-        expect(s, r == Z_OK);
+  System::Region* extract(const uint8_t* p, const uint8_t* start)
+  {
+    switch (compressionMethod(p)) {
+    case Stored: {
+      return new (allocator->allocate(sizeof(PointerRegion)))
+          PointerRegion(s,
+                        allocator,
+                        fileData(start + localHeaderOffset(p)),
+                        compressedSize(p));
+    } break;
 
-        r = inflate(&zStream, Z_FINISH);
-        expect(s, r == Z_STREAM_END);
+    case Deflated: {
+      DataRegion* region = new (
+          allocator->allocate(sizeof(DataRegion) + uncompressedSize(p)))
+          DataRegion(s, allocator, uncompressedSize(p));
 
-        inflateEnd(&zStream);
+      inflateEntry(s,
+                   fileData(start + localHeaderOffset(p)),
+                   compressedSize(p),
+                   region->data,
+                   region->length());
 
-        return region;
-      } break;
+      return region;
+    } break;
 
-      default:
-        abort(s);
-      }
+    default:
+      abort(s);
     }
-
-    return 0;
   }
 
   System::FileType stat(const char* name, size_t* length, bool tryDirectory)
@@ -510,6 +539,13 @@ class JarElement : public Element {
   {
   }
 
+  virtual JarIndex* jarIndex()
+  {
+    init();
+
+    return index;
+  }
+
   virtual Element::Iterator* iterator()
   {
     init();
@@ -547,6 +583,16 @@ class JarElement : public Element {
     return r;
   }
 
+  System::Region* extract(const uint8_t* entry)
+  {
+    return index->extract(entry, region->start());
+  }
+
+  const uint8_t* entryData(const uint8_t* entry)
+  {
+    return fileData(region->start() + localHeaderOffset(entry));
+  }
+
   virtual System::FileType stat(const char* name,
                                 size_t* length,
                                 bool tryDirectory)
@@ -625,7 +671,8 @@ class BuiltinElement : public JarElement {
     if (index == 0) {
       if (s->success(s->load(&library, libraryName))) {
         bool lzma = strncmp("lzma.", name, 5) == 0;
-        const char* symbolName = lzma ? name + 5 : name;
+        bool lz4 = strncmp("lz4.", name, 4) == 0;
+        const char* symbolName = lzma ? name + 5 : (lz4 ? name + 4 : name);
 
         void* p = library->resolve(symbolName);
         if (p) {
@@ -644,6 +691,15 @@ class BuiltinElement : public JarElement {
               freePointer = true;
 #else
               abort(s);
+#endif
+            } else if (lz4) {
+#ifdef AVIAN_USE_LZ4
+              size_t outSize;
+              data = decodeLZ4(s, allocator, data, size, &outSize);
+              size = outSize;
+              freePointer = true;
+#else
+              abort(s);
 #endif
             } else {
               freePointer = false;
@@ -924,6 +980,482 @@ Element* parsePath(System* s,
   return first;
 }
 
+// Maps each name found in any jar on the path to the first jar which
+// contains it, so that a lookup costs one hash probe rather than one
+// per jar.  Directories are not indexed since their contents may
+// change at any time; they are still searched in path order.
+class PathIndex {
+ public:
+  class Entry {
+   public:
+    Entry(uint32_t hash,
+          unsigned position,
+          JarElement* element,
+          const uint8_t* entry)
+        : hash(hash), position(position), element(element), entry(entry)
+    {
+    }
+
+    uint32_t hash;
+    unsigned position;
+    JarElement* element;
+    const uint8_t* entry;
+  };
+
+  PathIndex(System* s, Alloc* allocator, unsigned capacity)
+      : s(s),
+        allocator(allocator),
+        capacity(capacity),
+        position(0),
+        nodes(static_cast<List<Entry>*>(
+            allocator->allocate(sizeof(List<Entry>) * capacity)))
+  {
+    memset(table, 0, sizeof(List<Entry>*) * capacity);
+  }
+
+  static PathIndex* make(System* s, Alloc* allocator, Element* path)
+  {
+    unsigned count = 0;
+    for (Element* e = path; e; e = e->next) {
+      JarIndex* index = e->jarIndex();
+      if (index) {
+        count += index->position;
+      }
+    }
+
+    unsigned capacity = 32;
+    while (capacity < count) {
+      capacity *= 2;
+    }
+
+    PathIndex* index = new (allocator->allocate(
+        sizeof(PathIndex) + (sizeof(List<Entry>*) * capacity)))
+        PathIndex(s, allocator, capacity);
+
+    unsigned position = 0;
+    for (Element* e = path; e; e = e->next) {
+      JarIndex* jar = e->jarIndex();
+      if (jar) {
+        e->indexed = true;
+
+        for (unsigned i = 0; i < jar->position; ++i) {
+          const JarIndex::Entry& entry = jar->nodes[i].item;
+
+          // earlier jars shadow later ones:
+          if (index->findNode(entry.hash,
+                              fileName(entry.entry),
+                              fileNameLength(entry.entry)) == 0) {
+            index->add(Entry(entry.hash,
+                             position,
+                             static_cast<JarElement*>(e),
+                             entry.entry));
+          }
+        }
+      }
+      ++position;
+    }
+
+    if (DebugFind) {
+      fprintf(stderr, "indexed %d names on path\n", index->position);
+    }
+
+    return index;
+  }
+
+  void add(const Entry& entry)
+  {
+    assertT(s, position < capacity);
+
+    unsigned i = entry.hash & (capacity - 1);
+    table[i] = new (nodes + (position++)) List<Entry>(entry, table[i]);
+  }
+
+  List<Entry>* findNode(uint32_t hash, const uint8_t* name, size_t length)
+  {
+    unsigned i = hash & (capacity - 1);
+    for (List<Entry>* n = table[i]; n; n = n->next) {
+      const uint8_t* p = n->item.entry;
+      if (n->item.hash == hash
+          and equal(name, length, fileName(p), fileNameLength(p))) {
+        return n;
+      }
+    }
+    return 0;
+  }
+
+  List<Entry>* findNode(const char* name)
+  {
+    Slice<const uint8_t> n(reinterpret_cast<const uint8_t*>(name),
+                           strlen(name));
+    return findNode(hash(n), n.begin(), n.count);
+  }
+
+  // Returns the first entry on the path matching the specified name
+  // or, if tryDirectory is true, the name with '/' appended.
+  List<Entry>* find(const char* name, bool tryDirectory, bool* directory)
+  {
+    while (*name == '/')
+      name++;
+
+    List<Entry>* node = findNode(name);
+    *directory = false;
+
+    if (tryDirectory) {
+      size_t length = strlen(name);
+      RUNTIME_ARRAY(char, n, length + 2);
+      memcpy(RUNTIME_ARRAY_BODY(n), name, length);
+      RUNTIME_ARRAY_BODY(n)[length] = '/';
+      RUNTIME_ARRAY_BODY(n)[length + 1] = 0;
+
+      List<Entry>* directoryNode = findNode(RUNTIME_ARRAY_BODY(n));
+      if (directoryNode
+          and (node == 0
+               or directoryNode->item.position < node->item.position)) {
+        node = directoryNode;
+        *directory = true;
+      }
+    }
+
+    return node;
+  }
+
+  void dispose()
+  {
+    allocator->free(nodes, sizeof(List<Entry>) * capacity);
+    allocator->free(this, sizeof(*this) + (sizeof(List<Entry>*) * capacity));
+  }
+
+  System* s;
+  Alloc* allocator;
+  unsigned capacity;
+  unsigned position;
+
+  List<Entry>* nodes;
+  List<Entry>* table[0];
+};
+
+// Holds recently inflated jar entries, keyed by central directory
+// entry, so that resources which are read repeatedly need not be
+// inflated each time.  Regions are reference counted: the cache holds
+// one reference to each region it contains, and each caller of find
+// holds another until it disposes of the region.
+class RegionCache {
+ public:
+  class Region : public System::Region {
+   public:
+    Region(RegionCache* cache, const uint8_t* key, size_t length)
+        : cache(cache),
+          key(key),
+          length_(length),
+          references(1),
+          next(0),
+          younger(0),
+          older(0)
+    {
+    }
+
+    virtual const uint8_t* start()
+    {
+      return data;
+    }
+
+    virtual size_t length()
+    {
+      return length_;
+    }
+
+    virtual void dispose()
+    {
+      cache->release(this);
+    }
+
+    RegionCache* cache;
+    const uint8_t* key;
+    size_t length_;
+    unsigned references;
+    Region* next;
+    Region* younger;
+    Region* older;
+    uint8_t data[0];
+  };
+
+  static const unsigned BucketCount = 256;
+
+  RegionCache(System* s, Alloc* allocator, size_t capacity)
+      : s(s),
+        allocator(allocator),
+        capacity(capacity),
+        size(0),
+        youngest(0),
+        oldest(0)
+  {
+    expect(s, s->success(s->make(&lock)));
+    memset(table, 0, sizeof(Region*) * BucketCount);
+  }
+
+  Region* find(const uint8_t* key)
+  {
+    lock->acquire();
+    Region* r = lookup(key);
+    if (r) {
+      ++r->references;
+      unlink(r);
+      link(r);
+    }
+    lock->release();
+    return r;
+  }
+
+  Region* make(const uint8_t* key, size_t length)
+  {
+    return new (allocator->allocate(sizeof(Region) + length))
+        Region(this, key, length);
+  }
+
+  void add(Region* r)
+  {
+    lock->acquire();
+    // another thread may have inflated the same entry concurrently, in
+    // which case we leave its copy in place
+    if (lookup(r->key) == 0) {
+      ++r->references;
+
+      Region** bucket = table + index(r->key);
+      r->next = *bucket;
+      *bucket = r;
+
+      link(r);
+      size += r->length_;
+
+      while (size > capacity) {
+        evict(oldest);
+      }
+    }
+    lock->release();
+  }
+
+  void release(Region* r)
+  {
+    lock->acquire();
+    bool dead = --r->references == 0;
+    lock->release();
+
+    if (dead) {
+      free(r);
+    }
+  }
+
+  void dispose()
+  {
+    while (oldest) {
+      evict(oldest);
+    }
+    lock->dispose();
+  }
+
+ private:
+  unsigned index(const uint8_t* key)
+  {
+    return (reinterpret_cast<uintptr_t>(key) >> 4) & (BucketCount - 1);
+  }
+
+  Region* lookup(const uint8_t* key)
+  {
+    Region* r = table[index(key)];
+    while (r and r->key != key) {
+      r = r->next;
+    }
+    return r;
+  }
+
+  void link(Region* r)
+  {
+    r->younger = 0;
+    r->older = youngest;
+    if (youngest) {
+      youngest->younger = r;
+    } else {
+      oldest = r;
+    }
+    youngest = r;
+  }
+
+  void unlink(Region* r)
+  {
+    if (r->younger) {
+      r->younger->older = r->older;
+    } else {
+      youngest = r->older;
+    }
+    if (r->older) {
+      r->older->younger = r->younger;
+    } else {
+      oldest = r->younger;
+    }
+  }
+
+  void evict(Region* r)
+  {
+    Region** p = table + index(r->key);
+    while (*p != r) {
+      p = &((*p)->next);
+    }
+    *p = r->next;
+
+    unlink(r);
+    size -= r->length_;
+
+    if (--r->references == 0) {
+      free(r);
+    }
+  }
+
+  void free(Region* r)
+  {
+    allocator->free(r, sizeof(Region) + r->length_);
+  }
+
+  System* s;
+  Alloc* allocator;
+  System::Mutex* lock;
+  size_t capacity;
+  size_t size;
+  Region* youngest;
+  Region* oldest;
+  Region* table[BucketCount];
+};
+
+class RegionStream : public Finder::Stream {
+ public:
+  RegionStream(Alloc* allocator, System::Region* region)
+      : allocator(allocator), region(region)
+  {
+  }
+
+  virtual size_t length()
+  {
+    return region->length();
+  }
+
+  virtual size_t read(size_t position, uint8_t* dst, size_t length)
+  {
+    if (position >= region->length()) {
+      return 0;
+    }
+
+    if (length > region->length() - position) {
+      length = region->length() - position;
+    }
+    memcpy(dst, region->start() + position, length);
+    return length;
+  }
+
+  virtual void dispose()
+  {
+    region->dispose();
+    allocator->free(this, sizeof(*this));
+  }
+
+  Alloc* allocator;
+  System::Region* region;
+};
+
+// Inflates a large jar entry on demand as it is read rather than all at
+// once.
+class InflateStream : public Finder::Stream {
+ public:
+  InflateStream(System* s,
+                Alloc* allocator,
+                const uint8_t* in,
+                size_t inSize,
+                size_t length)
+      : s(s),
+        allocator(allocator),
+        in(in),
+        inSize(inSize),
+        length_(length),
+        position(0)
+  {
+    memset(&zStream, 0, sizeof(z_stream));
+
+    zStream.next_in = const_cast<uint8_t*>(in);
+    zStream.avail_in = inSize;
+
+    // -15 means max window size and raw deflate (no zlib wrapper)
+    int r = inflateInit2(&zStream, -15);
+    expect(s, r == Z_OK);
+  }
+
+  virtual size_t length()
+  {
+    return length_;
+  }
+
+  virtual size_t read(size_t position, uint8_t* dst, size_t length)
+  {
+    if (position >= length_) {
+      return 0;
+    }
+
+    if (position < this->position) {
+      // start over from the beginning
+      int r = inflateReset(&zStream);
+      expect(s, r == Z_OK);
+
+      zStream.next_in = const_cast<uint8_t*>(in);
+      zStream.avail_in = inSize;
+      this->position = 0;
+    }
+
+    while (this->position < position) {
+      const size_t BufferSize = 4096;
+      uint8_t buffer[BufferSize];
+      size_t skip = position - this->position;
+      produce(buffer, skip > BufferSize ? BufferSize : skip);
+    }
+
+    if (length > length_ - position) {
+      length = length_ - position;
+    }
+    return produce(dst, length);
+  }
+
+  virtual void dispose()
+  {
+    inflateEnd(&zStream);
+    allocator->free(this, sizeof(*this));
+  }
+
+  size_t produce(uint8_t* dst, size_t length)
+  {
+    zStream.next_out = dst;
+    zStream.avail_out = length;
+
+    while (zStream.avail_out) {
+      int r = inflate(&zStream, Z_NO_FLUSH);
+      expect(s, r == Z_OK or r == Z_STREAM_END);
+
+      if (r == Z_STREAM_END) {
+        break;
+      }
+    }
+
+    size_t count = length - zStream.avail_out;
+    position += count;
+    expect(s, count == length);
+
+    return count;
+  }
+
+  System* s;
+  Alloc* allocator;
+  const uint8_t* in;
+  size_t inSize;
+  size_t length_;
+  size_t position;
+  z_stream zStream;
+};
+
 class MyIterator : public Finder::IteratorImp {
  public:
   MyIterator(System* s, Alloc* allocator, Element* path)
@@ -975,8 +1507,11 @@ class MyFinder : public Finder {
       : system(system),
         allocator(allocator),
         path_(parsePath(system, allocator, path, bootLibrary)),
-        pathString(copy(allocator, path))
+        pathString(copy(allocator, path)),
+        index(0),
+        cache(system, allocator, CacheCapacity)
   {
+    expect(system, system->success(system->make(&indexLock)));
   }
 
   MyFinder(System* system,
@@ -987,8 +1522,11 @@ class MyFinder : public Finder {
         allocator(allocator),
         path_(new (allocator->allocate(sizeof(JarElement)))
               JarElement(system, allocator, jarData, jarLength)),
-        pathString(0)
+        pathString(0),
+        index(0),
+        cache(system, allocator, CacheCapacity)
   {
+    expect(system, system->success(system->make(&indexLock)));
   }
 
   virtual IteratorImp* iterator()
@@ -997,36 +1535,158 @@ class MyFinder : public Finder {
         MyIterator(system, allocator, path_);
   }
 
+  PathIndex* pathIndex()
+  {
+    if (index == 0) {
+      indexLock->acquire();
+      if (index == 0) {
+        PathIndex* v = PathIndex::make(system, allocator, path_);
+        storeStoreMemoryBarrier();
+        index = v;
+      }
+      indexLock->release();
+    }
+    return index;
+  }
+
+  // Finds the first element on the path containing the specified name,
+  // consulting the index for jars and searching any directories which
+  // precede the first matching jar.
+  Element* locate(const char* name,
+                  bool tryDirectory,
+                  size_t* length,
+                  System::FileType* type)
+  {
+    bool directory;
+    List<PathIndex::Entry>* node
+        = pathIndex()->find(name, tryDirectory, &directory);
+    Element* limit = node ? node->item.element : 0;
+
+    for (Element* e = path_; e != limit; e = e->next) {
+      if (not e->indexed) {
+        *type = e->stat(name, length, tryDirectory);
+        if (*type != System::TypeDoesNotExist) {
+          return e;
+        }
+      }
+    }
+
+    if (node) {
+      if (directory) {
+        *length = 0;
+        *type = System::TypeDirectory;
+      } else {
+        *length = uncompressedSize(node->item.entry);
+        *type = System::TypeFile;
+      }
+    } else {
+      *type = System::TypeDoesNotExist;
+    }
+
+    return limit;
+  }
+
+  // Finds the index node for the first jar containing the specified
+  // name, unless an element which precedes that jar but is not indexed
+  // also contains it, in which case that element's region is returned
+  // instead.
+  List<PathIndex::Entry>* findNode(const char* name, System::Region** region)
+  {
+    bool directory;
+    List<PathIndex::Entry>* node = pathIndex()->find(name, false, &directory);
+    Element* limit = node ? node->item.element : 0;
+
+    for (Element* e = path_; e != limit; e = e->next) {
+      if (not e->indexed) {
+        System::Region* r = e->find(name);
+        if (r) {
+          *region = r;
+          return 0;
+        }
+      }
+    }
+
+    if (node and DebugFind) {
+      fprintf(stderr, "found %s in %s\n", name, node->item.element->name);
+    }
+
+    *region = 0;
+    return node;
+  }
+
+  System::Region* extract(const char* name, const PathIndex::Entry& entry)
+  {
+    const uint8_t* p = entry.entry;
+
+    // classes are only loaded once, so there's no point in caching them
+    size_t nameLength = strlen(name);
+    bool isClass = nameLength > 6
+                   and strcmp(name + nameLength - 6, ".class") == 0;
+
+    if (compressionMethod(p) == JarIndex::Deflated
+        and uncompressedSize(p) < LargeEntrySize and not isClass) {
+      RegionCache::Region* r = cache.find(p);
+      if (r == 0) {
+        r = cache.make(p, uncompressedSize(p));
+        inflateEntry(system,
+                     entry.element->entryData(p),
+                     compressedSize(p),
+                     r->data,
+                     r->length());
+        cache.add(r);
+      }
+      return r;
+    }
+
+    return entry.element->extract(p);
+  }
+
   virtual System::Region* find(const char* name)
   {
-    for (Element* e = path_; e; e = e->next) {
-      System::Region* r = e->find(name);
-      if (r) {
-        return r;
+    System::Region* region;
+    List<PathIndex::Entry>* node = findNode(name, &region);
+    return node ? extract(name, node->item) : region;
+  }
+
+  virtual Stream* open(const char* name)
+  {
+    System::Region* region;
+    List<PathIndex::Entry>* node = findNode(name, &region);
+    if (node) {
+      const uint8_t* p = node->item.entry;
+      if (compressionMethod(p) == JarIndex::Deflated
+          and uncompressedSize(p) >= LargeEntrySize) {
+        return new (allocator->allocate(sizeof(InflateStream)))
+            InflateStream(system,
+                          allocator,
+                          node->item.element->entryData(p),
+                          compressedSize(p),
+                          uncompressedSize(p));
       }
+
+      region = extract(name, node->item);
     }
 
-    return 0;
+    return region ? new (allocator->allocate(sizeof(RegionStream)))
+                        RegionStream(allocator, region)
+                  : 0;
   }
 
   virtual System::FileType stat(const char* name,
                                 size_t* length,
                                 bool tryDirectory)
   {
-    for (Element* e = path_; e; e = e->next) {
-      System::FileType type = e->stat(name, length, tryDirectory);
-      if (type != System::TypeDoesNotExist) {
-        return type;
-      }
-    }
-
-    return System::TypeDoesNotExist;
+    System::FileType type;
+    locate(name, tryDirectory, length, &type);
+    return type;
   }
 
   virtual const char* urlPrefix(const char* name)
   {
-    void* finderElementPtr = NULL;
-    return nextUrlPrefix(name, finderElementPtr);
+    size_t length;
+    System::FileType type;
+    Element* e = locate(name, true, &length, &type);
+    return e ? e->urlPrefix() : 0;
   }
 
   virtual const char* nextUrlPrefix(const char* name, void*& finderElementPtr)
@@ -1046,15 +1706,10 @@ class MyFinder : public Finder {
 
   virtual const char* sourceUrl(const char* name)
   {
-    for (Element* e = path_; e; e = e->next) {
-      size_t length;
-      System::FileType type = e->stat(name, &length, true);
-      if (type != System::TypeDoesNotExist) {
-        return e->sourceUrl();
-      }
-    }
-
-    return 0;
+    size_t length;
+    System::FileType type;
+    Element* e = locate(name, true, &length, &type);
+    return e ? e->sourceUrl() : 0;
   }
 
   virtual const char* path()
@@ -1072,6 +1727,11 @@ class MyFinder : public Finder {
     if (pathString) {
       allocator->free(pathString, strlen(pathString) + 1);
     }
+    if (index) {
+      index->dispose();
+    }
+    indexLock->dispose();
+    cache.dispose();
     allocator->free(this, sizeof(*this));
   }
 
@@ -1079,6 +1739,9 @@ class MyFinder : public Finder {
   Alloc* allocator;
   Element* path_;
   const char* pathString;
+  System::Mutex* indexLock;
+  PathIndex* index;
+  RegionCache cache;
 };
 
 }  // namespace
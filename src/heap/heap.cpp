@@ -10,6 +10,7 @@
 
 #include <avian/heap/heap.h>
 #include <avian/system/system.h>
+#include <avian/system/memory.h>
 #include "avian/common.h"
 #include "avian/arch.h"
 
@@ -17,6 +18,7 @@
 
 using namespace vm;
 using namespace avian::util;
+using avian::system::Memory;
 
 namespace {
 
@@ -27,6 +29,65 @@ const unsigned Top = ~static_cast<unsigned>(0);
 const unsigned InitialGen2CapacityInBytes = 4 * 1024 * 1024;
 const unsigned InitialTenuredFixieCeilingInBytes = 4 * 1024 * 1024;
 
+// bounds on how much the client may allocate outside the heap between
+// minor collections, which we adjust to meet the pause and overhead
+// goals.  None may exceed an eighth of the heap limit:
+const unsigned MinimumIncomingLimitInBytes = 512 * 1024;
+const unsigned InitialIncomingLimitInBytes = 4 * 1024 * 1024;
+const unsigned MaximumIncomingLimitInBytes = 64 * 1024 * 1024;
+
+// how often we compare the time spent collecting with the goals:
+const unsigned GoalIntervalInMilliseconds = 1000;
+
+// cohorts of objects smaller than this say too little about how long
+// objects tend to live to be worth adjusting the tenure threshold for:
+const unsigned MinimumCohortInBytes = 64 * 1024;
+
+// when pretenuring, we sample how much of what each allocation site
+// produces lives to be tenured, hashing sites into this many buckets,
+// and then copy objects from the sites which tenure nearly everything
+// straight to gen2 for this many collections before sampling again:
+const unsigned PretenureSiteBits = 10;
+const unsigned PretenureSiteCount = 1 << PretenureSiteBits;
+const unsigned PretenureHoldCollections = 64;
+
+// sites which produce less than this during a sample say too little
+// about how long their objects live to be worth pretenuring:
+const unsigned MinimumSiteFootprintInBytes = 16 * 1024;
+
+// when traversing with an explicit stack, we gather up to this many
+// fields of an object before updating them, prefetching the objects
+// they point to as we go:
+const unsigned TraversalBatchSize = 16;
+
+// blocks at least this big are mapped directly from the OS, so they
+// can be given back as soon as they are freed:
+const unsigned MinimumMappedBlockInBytes = 64 * 1024;
+
+// freed runs of pages for large objects are kept for reuse up to this
+// total and beyond that given back to the OS:
+const unsigned MaximumLargeCacheInBytes = 16 * 1024 * 1024;
+
+// by default we size gen2 to leave between these percentages of it
+// free after a major collection, giving back memory beyond the latter:
+const unsigned DefaultMinimumFreePercent = 50;
+const unsigned DefaultMaximumFreePercent = 75;
+
+// free gen2 chunks shorter than this aren't worth releasing to the OS:
+const unsigned MinimumReleasedChunkInBytes = 64 * 1024;
+
+// runs of free gen2 words shorter than this are not worth tracking and
+// are left for the next copying collection to reclaim:
+const unsigned MinimumFreeChunkInWords = 4;
+
+// give up searching the gen2 free list for a chunk large enough to
+// hold an object after this many misses and use the end of gen2:
+const unsigned MaximumFreeChunkProbes = 8;
+
+// check the clock every time this many objects have been marked or
+// swept during an incremental step:
+const unsigned IncrementSize = 64;
+
 const bool Verbose = false;
 const bool Verbose2 = false;
 const bool Debug = false;
@@ -544,6 +605,8 @@ class Fixie {
   static const unsigned Marked = 1 << 1;
   static const unsigned Dirty = 1 << 2;
   static const unsigned Dead = 1 << 3;
+  static const unsigned Traced = 1 << 4;
+  static const unsigned Large = 1 << 5;
 
   Fixie(Context* c, unsigned size, bool hasMask, Fixie** handle, bool immortal)
       : age(immortal ? FixieTenureThreshold + 1 : 0),
@@ -633,6 +696,11 @@ class Fixie {
     return (flags & HasMask) != 0;
   }
 
+  bool large()
+  {
+    return (flags & Large) != 0;
+  }
+
   bool marked()
   {
     return (flags & Marked) != 0;
@@ -675,6 +743,20 @@ class Fixie {
     }
   }
 
+  bool traced()
+  {
+    return (flags & Traced) != 0;
+  }
+
+  void traced(bool v)
+  {
+    if (v) {
+      flags |= Traced;
+    } else {
+      flags &= ~Traced;
+    }
+  }
+
   // be sure to update e.g. TargetFixieSizeInBytes in bootimage.cpp if
   // you add/remove/change fields in this class:
 
@@ -692,6 +774,52 @@ Fixie* fixie(void* body)
 }
 
 void free(Context* c, Fixie** fixies, bool resetImmortal = false);
+unsigned largeBlockSize(unsigned size);
+void freeLarge(Context* c, void* p, unsigned size);
+
+class Stack {
+ public:
+  Stack() : data(0), size(0), capacity(0)
+  {
+  }
+
+  void** data;
+  unsigned size;
+  unsigned capacity;
+};
+
+// a run of pages which held a large object and may be reused for
+// another of the same size class:
+class LargeBlock {
+ public:
+  unsigned size;
+  LargeBlock* next;
+};
+
+// a run of unused words in gen2, found by sweeping after an
+// incremental collection and reused when objects are tenured:
+class FreeChunk {
+ public:
+  uintptr_t size;
+  FreeChunk* next;
+};
+
+void releaseBitmaps(Context* c);
+void releaseLargeCache(Context* c);
+void release(Context* c, Stack* s);
+void collect(Context* c, void* target, unsigned offset);
+
+enum Phase {
+  // no incremental or in-place collection of gen2 is in progress
+  Idle,
+
+  // gen2 is being marked in steps at the end of each minor
+  // collection, and will be swept in place once marking is complete
+  Marking,
+
+  // unmarked gen2 objects are being added to the free list in steps
+  Sweeping
+};
 
 class Context {
  public:
@@ -703,9 +831,9 @@ class Context {
         lock(0),
         immortalHeapStart(0),
         immortalHeapEnd(0),
-        ageMap(&gen1, max(1, log(TenureThreshold)), 1, 0, false),
+        ageMap(&gen1, max(1, log(MaximumTenureThreshold)), 1, 0, false),
         gen1(this, &ageMap, 0, 0),
-        nextAgeMap(&nextGen1, max(1, log(TenureThreshold)), 1, 0, false),
+        nextAgeMap(&nextGen1, max(1, log(MaximumTenureThreshold)), 1, 0, false),
         nextGen1(this, &nextAgeMap, 0, 0),
         pointerMap(&gen2, 1, 1, 0, true),
         pageMap(&gen2,
@@ -723,6 +851,43 @@ class Context {
                     true),
         nextHeapMap(&nextGen2, 1, nextPageMap.scale * 1024, &nextPageMap, true),
         nextGen2(this, &nextHeapMap, 0, 0),
+        markMap(&gen2, 1, 1, 0, false),
+        freshMap(&gen2, 1, 1, 0, false),
+        freeList(0),
+        lastFreeChunk(0),
+        gen2Free(0),
+        freshStart(Top),
+        freshEnd(0),
+        sweepPosition(0),
+        sweepEnd(0),
+        windowStart(Top),
+        windowEnd(0),
+        phase(Idle),
+        inPlace(false),
+        compacting(false),
+        remarkPending(false),
+        pauseBudget(0),
+        compaction(false),
+        growGen2(false),
+        stackTraversal(false),
+        pretenuring(false),
+        pretenureSampling(false),
+        pretenureCountdown(0),
+        tenureThreshold(TenureThreshold),
+        fixedTenureThreshold(false),
+        pauseGoal(0),
+        overheadGoal(0),
+        incomingLimit(min(InitialIncomingLimitInBytes, limit / 8)),
+        tenuredGen1Footprint(0),
+        goalStartTime(system->now()),
+        goalCollectionTime(0),
+        maximumPause(0),
+        minimumFreePercent(DefaultMinimumFreePercent),
+        maximumFreePercent(DefaultMaximumFreePercent),
+        hugePages(false),
+        largeFreeList(0),
+        largeCacheFootprint(0),
+        largeFootprint(0),
         gen2Base(0),
         incomingFootprint(0),
         pendingAllocation(0),
@@ -745,6 +910,10 @@ class Context {
         totalTime(0),
         limitWasExceeded(false)
   {
+    memset(ageFootprint, 0, sizeof(ageFootprint));
+    memset(lastAgeFootprint, 0, sizeof(lastAgeFootprint));
+    memset(pretenuredSites, 0, sizeof(pretenuredSites));
+
     if (not system->success(system->make(&lock))) {
       system->abort();
     }
@@ -752,10 +921,16 @@ class Context {
 
   void dispose()
   {
+    releaseBitmaps(this);
+    release(this, &markStack);
+    release(this, &tracedFixies);
+    release(this, &scanStack);
+
     gen1.dispose();
     nextGen1.dispose();
     gen2.dispose();
     nextGen2.dispose();
+    releaseLargeCache(this);
     lock->dispose();
   }
 
@@ -793,6 +968,80 @@ class Context {
   Segment::Map nextHeapMap;
   Segment nextGen2;
 
+  // mark bits for gen2 objects during an incremental or in-place
+  // collection, and the objects tenured or evacuated into free chunks
+  // during the current collection, which are as fresh as those beyond
+  // gen2Base.  Within the evacuation window, freshMap instead marks
+  // the objects which have been evacuated:
+  Segment::Map markMap;
+  Segment::Map freshMap;
+
+  Stack markStack;
+  Stack tracedFixies;
+
+  // copies whose fields have yet to be updated when traversing with an
+  // explicit stack instead of by pointer reversal:
+  Stack scanStack;
+
+  FreeChunk* freeList;
+  FreeChunk* lastFreeChunk;
+  unsigned gen2Free;
+
+  unsigned freshStart;
+  unsigned freshEnd;
+
+  unsigned sweepPosition;
+  unsigned sweepEnd;
+
+  // the part of gen2 we are evacuating into free chunks below it
+  // during an in-place major collection, if any
+  unsigned windowStart;
+  unsigned windowEnd;
+
+  Phase phase;
+  bool inPlace;
+  bool compacting;
+  bool remarkPending;
+  unsigned pauseBudget;
+  bool compaction;
+  bool growGen2;
+  bool stackTraversal;
+
+  // the volume of objects each site (by bucket) has had copied out of
+  // the nursery during the current sample, and of those tenured from
+  // gen1, along with the sites we are pretenuring otherwise:
+  bool pretenuring;
+  bool pretenureSampling;
+  unsigned pretenureCountdown;
+  unsigned siteFootprint[PretenureSiteCount];
+  unsigned siteTenuredFootprint[PretenureSiteCount];
+  uintptr_t pretenuredSites[PretenureSiteCount / BitsPerWord];
+
+  unsigned tenureThreshold;
+  bool fixedTenureThreshold;
+  unsigned pauseGoal;
+  unsigned overheadGoal;
+  unsigned incomingLimit;
+
+  // the volume of objects copied within gen1 at each age during this
+  // collection and the last one, and of those tenured from gen1:
+  unsigned ageFootprint[MaximumTenureThreshold + 1];
+  unsigned lastAgeFootprint[MaximumTenureThreshold + 1];
+  unsigned tenuredGen1Footprint;
+
+  int64_t goalStartTime;
+  int64_t goalCollectionTime;
+  unsigned maximumPause;
+
+  unsigned minimumFreePercent;
+  unsigned maximumFreePercent;
+
+  bool hugePages;
+
+  LargeBlock* largeFreeList;
+  unsigned largeCacheFootprint;
+  unsigned largeFootprint;
+
   unsigned gen2Base;
 
   unsigned incomingFootprint;
@@ -842,6 +1091,11 @@ inline Aborter* getAborter(Context* c)
   return c->system;
 }
 
+inline bool copyingGen2(Context* c)
+{
+  return c->mode == Heap::MajorCollection and not c->inPlace;
+}
+
 inline unsigned minimumNextGen1Capacity(Context* c)
 {
   return c->gen1.position() - c->tenureFootprint + c->incomingFootprint
@@ -857,15 +1111,30 @@ inline unsigned minimumNextGen2Capacity(Context* c)
 inline bool oversizedGen2(Context* c)
 {
   return c->gen2.capacity() > (InitialGen2CapacityInBytes / BytesPerWord)
-         and c->gen2.position() < (c->gen2.capacity() / 4);
+         and static_cast<uint64_t>(c->gen2.position()) * 100
+             < static_cast<uint64_t>(c->gen2.capacity())
+               * (100 - c->maximumFreePercent);
 }
 
 inline void initNextGen1(Context* c)
 {
-  new (&(c->nextAgeMap))
-      Segment::Map(&(c->nextGen1), max(1, log(TenureThreshold)), 1, 0, false);
+  new (&(c->nextAgeMap)) Segment::Map(
+      &(c->nextGen1), max(1, log(MaximumTenureThreshold)), 1, 0, false);
 
   unsigned minimum = minimumNextGen1Capacity(c);
+
+  if (not copyingGen2(c)) {
+    // objects which can't be tenured for lack of a large enough free
+    // chunk in gen2 stay in gen1 until the next collection, so make
+    // room for them here.  Since the end of gen2 may be too short for
+    // the last of them, we can't count on it to hold any particular
+    // share:
+    unsigned tenure = c->tenureFootprint + c->tenurePadding;
+    if (tenure > c->gen2.remaining()) {
+      minimum += tenure;
+    }
+  }
+
   unsigned desired = minimum;
 
   new (&(c->nextGen1)) Segment(c, &(c->nextAgeMap), desired, minimum);
@@ -894,7 +1163,14 @@ inline void initNextGen2(Context* c)
   unsigned desired = minimum;
 
   if (not oversizedGen2(c)) {
-    desired *= 2;
+    uint64_t target = static_cast<uint64_t>(desired) * 100
+                      / (100 - c->minimumFreePercent);
+
+    if (target > c->limit / BytesPerWord) {
+      target = c->limit / BytesPerWord;
+    }
+
+    desired = max(desired, static_cast<unsigned>(target));
   }
 
   if (desired < InitialGen2CapacityInBytes / BytesPerWord) {
@@ -921,7 +1197,11 @@ inline void initNextGen2(Context* c)
 inline bool fresh(Context* c, void* o)
 {
   return c->nextGen1.contains(o) or c->nextGen2.contains(o)
-         or (c->gen2.contains(o) and c->gen2.indexOf(o) >= c->gen2Base);
+         or (c->gen2.contains(o)
+             and (c->gen2.indexOf(o) >= c->gen2Base
+                  or (c->freshStart != Top
+                      and c->gen2.indexOf(o) < c->windowStart
+                      and getBit(c->freshMap.data, c->gen2.indexOf(o)))));
 }
 
 inline bool wasCollected(Context* c, void* o)
@@ -971,7 +1251,11 @@ void free(Context* c, Fixie** fixies, bool resetImmortal)
       if (DebugFixies) {
         fprintf(stderr, "free fixie %p\n", f);
       }
-      free(c, f, f->totalSize());
+      if (f->large()) {
+        freeLarge(c, f, largeBlockSize(f->totalSize()));
+      } else {
+        free(c, f, f->totalSize());
+      }
     }
   }
 }
@@ -989,7 +1273,7 @@ void killFixies(Context* c)
 {
   assertT(c, c->markedFixies == 0);
 
-  if (c->mode == Heap::MajorCollection) {
+  if (copyingGen2(c)) {
     kill(c->tenuredFixies);
     kill(c->dirtyTenuredFixies);
   }
@@ -1000,7 +1284,7 @@ void sweepFixies(Context* c)
 {
   assertT(c, c->markedFixies == 0);
 
-  if (c->mode == Heap::MajorCollection) {
+  if (copyingGen2(c)) {
     free(c, &(c->tenuredFixies), true);
     free(c, &(c->dirtyTenuredFixies), true);
 
@@ -1063,236 +1347,842 @@ bool immortalHeapContains(Context* c, void* p)
   return p < c->immortalHeapEnd and p >= c->immortalHeapStart;
 }
 
-void* copy2(Context* c, void* o)
+void push(Context* c, Stack* s, void* p)
 {
-  unsigned size = c->client->copiedSizeInWords(o);
+  if (s->size == s->capacity) {
+    // this may be called from MyHeap::mark with c->lock held, so we
+    // use the system allocator rather than local::allocate here:
+    unsigned capacity = max(s->capacity * 2, 256);
+    void** data
+        = static_cast<void**>(c->system->tryAllocate(capacity * BytesPerWord));
+    expect(c->system, data);
 
-  if (c->gen2.contains(o)) {
-    assertT(c, c->mode == Heap::MajorCollection);
+    if (s->data) {
+      memcpy(data, s->data, s->size * BytesPerWord);
+      c->system->free(s->data);
+    }
 
-    return copyTo(c, &(c->nextGen2), o, size);
-  } else if (c->gen1.contains(o)) {
-    unsigned age = c->ageMap.get(o);
-    if (age == TenureThreshold) {
-      if (c->mode == Heap::MinorCollection) {
-        assertT(c, c->gen2.remaining() >= size);
+    s->data = data;
+    s->capacity = capacity;
+  }
 
-        if (c->gen2Base == Top) {
-          c->gen2Base = c->gen2.position();
-        }
+  s->data[s->size++] = p;
+}
 
-        return copyTo(c, &(c->gen2), o, size);
-      } else {
-        return copyTo(c, &(c->nextGen2), o, size);
-      }
-    } else {
-      o = copyTo(c, &(c->nextGen1), o, size);
+inline void* pop(Stack* s)
+{
+  return s->data[--s->size];
+}
 
-      c->nextAgeMap.setOnly(o, age + 1);
-      if (age + 1 == TenureThreshold) {
-        c->tenureFootprint += size;
-      }
+void release(Context* c, Stack* s)
+{
+  if (s->data) {
+    c->system->free(s->data);
+  }
+  s->data = 0;
+  s->size = 0;
+  s->capacity = 0;
+}
 
-      return o;
+bool acquireBitmaps(Context* c)
+{
+  if (c->markMap.data == 0) {
+    if (c->gen2.capacity() == 0) {
+      return false;
     }
-  } else {
-    assertT(c, not c->nextGen1.contains(o));
-    assertT(c, not c->nextGen2.contains(o));
-    assertT(c, not immortalHeapContains(c, o));
 
-    o = copyTo(c, &(c->nextGen1), o, size);
+    unsigned size = c->markMap.size();
+    uintptr_t* data = static_cast<uintptr_t*>(
+        allocate(c, size * 2 * BytesPerWord, true));
+    if (data == 0) {
+      return false;
+    }
 
-    c->nextAgeMap.clear(o);
+    memset(data, 0, size * 2 * BytesPerWord);
 
-    return o;
+    c->markMap.data = data;
+    c->freshMap.data = data + size;
   }
+
+  return true;
 }
 
-void* copy(Context* c, void* o)
+void releaseBitmaps(Context* c)
 {
-  void* r = copy2(c, o);
-
-  if (Debug) {
-    fprintf(stderr,
-            "copy %p (%s) to %p (%s)\n",
-            o,
-            segment(c, o),
-            r,
-            segment(c, r));
+  if (c->markMap.data) {
+    free(c, c->markMap.data, c->markMap.size() * 2 * BytesPerWord);
+    c->markMap.data = 0;
+    c->freshMap.data = 0;
   }
+}
 
-  // leave a pointer to the copy in the original
-  fieldAtOffset<void*>(o, 0) = r;
-
-  return r;
+void clearRange(uintptr_t* map, unsigned start, unsigned end)
+{
+  for (; start < end and bitOf(start); ++start) {
+    clearBit(map, start);
+  }
+  for (; start + BitsPerWord <= end; start += BitsPerWord) {
+    map[wordOf(start)] = 0;
+  }
+  for (; start < end; ++start) {
+    clearBit(map, start);
+  }
 }
 
-void* update3(Context* c, void* o, bool* needsVisit)
+unsigned nextBit(uintptr_t* map, unsigned start, unsigned end)
 {
-  if (c->client->isFixed(o)) {
-    Fixie* f = fixie(o);
-    if ((not f->marked()) and (c->mode == Heap::MajorCollection
-                               or f->age < FixieTenureThreshold)) {
-      if (DebugFixies) {
-        fprintf(stderr, "mark fixie %p\n", f);
+  while (start < end) {
+    uintptr_t w = map[wordOf(start)] >> bitOf(start);
+    if (w) {
+      for (; (w & 1) == 0; w >>= 1) {
+        ++start;
       }
-      f->marked(true);
-      f->dead(false);
-      f->move(c, &(c->markedFixies));
+      return start < end ? start : end;
     }
-    *needsVisit = false;
-    return o;
-  } else if (immortalHeapContains(c, o)) {
-    *needsVisit = false;
-    return o;
-  } else if (wasCollected(c, o)) {
-    *needsVisit = false;
-    return follow(c, o);
-  } else {
-    *needsVisit = true;
-    return copy(c, o);
+    start = indexOf(wordOf(start) + 1, 0);
   }
+  return end;
 }
 
-void* update2(Context* c, void* o, bool* needsVisit)
+// clears the remembered set for [start, end) in the specified map and
+// its children, leaving the summary bits of any partially covered
+// pages set only if something in them is still marked
+void clearRange(Context* c, Segment::Map* map, unsigned start, unsigned end)
 {
-  if (c->mode == Heap::MinorCollection and c->gen2.contains(o)) {
-    *needsVisit = false;
-    return o;
+  if (map->child) {
+    clearRange(c, map->child, start, end);
+
+    for (unsigned i = start - (start % map->scale); i < end; i += map->scale) {
+      if (i < start or i + map->scale > end) {
+        Segment::Map::Iterator it(map->child, i, i + map->scale);
+        if (it.hasMore()) {
+          continue;
+        }
+      }
+      map->clearOnly(i);
+    }
+  } else {
+    assertT(c, map->scale == 1 and map->bitsPerRecord == 1);
+    clearRange(map->data, start, end);
   }
-
-  return update3(c, o, needsVisit);
 }
 
-void markDirty(Context* c, Fixie* f)
+inline bool marked(Context* c, void* o)
 {
-  if (not f->dirty()) {
-#ifdef USE_ATOMIC_OPERATIONS
-    ACQUIRE(c->lock);
-#endif
+  return getBit(c->markMap.data, c->gen2.indexOf(o));
+}
 
-    if (not f->dirty()) {
-      f->dirty(true);
-      f->move(c, &(c->dirtyTenuredFixies));
-    }
+inline bool inWindow(Context* c, void* o)
+{
+  if (c->gen2.contains(o)) {
+    unsigned i = c->gen2.indexOf(o);
+    return i >= c->windowStart and i < c->windowEnd;
+  } else {
+    return false;
   }
 }
 
-void markClean(Context* c, Fixie* f)
+// returns true if the specified object has been moved out of the
+// evacuation window, leaving a pointer to its copy in its first word
+inline bool evacuated(Context* c, void* o)
 {
-  if (f->dirty()) {
-    f->dirty(false);
-    if (f->immortal()) {
-      f->remove(c);
-    } else {
-      f->move(c, &(c->tenuredFixies));
+  return inWindow(c, o) and getBit(c->freshMap.data, c->gen2.indexOf(o));
+}
+
+// marks the specified gen2 object or tenured fixie, if it is not
+// already marked, and pushes it on the mark stack to be traced later
+void shade(Context* c, void* o)
+{
+  if (c->gen2.contains(o)) {
+    unsigned i = c->gen2.indexOf(o);
+    if (not getBit(c->markMap.data, i)) {
+      markBit(c->markMap.data, i);
+      push(c, &(c->markStack), o);
+    }
+  } else if (not(c->gen1.contains(o) or c->nextGen1.contains(o)
+                 or immortalHeapContains(c, o))
+             and c->client->isFixed(o)) {
+    Fixie* f = fixie(o);
+    if (f->age >= FixieTenureThreshold and not f->traced()) {
+      f->traced(true);
+      push(c, &(c->tracedFixies), f);
+      push(c, &(c->markStack), o);
     }
   }
 }
 
-void updateHeapMap(Context* c,
-                   void* p,
-                   void* target,
-                   unsigned offset,
-                   void* result)
+// traces objects from the mark stack until it is empty or the
+// deadline (if any) has passed, returning true in the former case
+bool drain(Context* c, int64_t deadline)
 {
-  Segment* seg;
-  Segment::Map* map;
-
-  if (c->mode == Heap::MinorCollection) {
-    seg = &(c->gen2);
-    map = &(c->heapMap);
-  } else {
-    seg = &(c->nextGen2);
-    map = &(c->nextHeapMap);
-  }
+  class Walker : public Heap::Walker {
+   public:
+    Walker(Context* c, void* p) : c(c), p(p)
+    {
+    }
 
-  if (not(immortalHeapContains(c, result)
-          or (c->client->isFixed(result)
-              and fixie(result)->age >= FixieTenureThreshold)
-          or seg->contains(result))) {
-    if (target and c->client->isFixed(target)) {
-      Fixie* f = fixie(target);
-      assertT(c, offset == 0 or f->hasMask());
+    virtual bool visit(unsigned offset)
+    {
+      void* o = get(p, offset);
+      if (inWindow(c, o)) {
+        // the object may be evacuated, so the field must be updated
+        // rather than just shaded:
+        local::collect(c, p, offset);
+      } else if (o) {
+        shade(c, o);
+      }
+      return true;
+    }
 
-      if (static_cast<unsigned>(f->age + 1) >= FixieTenureThreshold) {
-        if (DebugFixies) {
-          fprintf(stderr,
-                  "dirty fixie %p at %d (%p): %p\n",
-                  f,
-                  offset,
-                  f->body() + offset,
-                  result);
-        }
+    Context* c;
+    void* p;
+  };
 
-        f->dirty(true);
-        markBit(f->mask(), offset);
-      }
-    } else if (seg->contains(p)) {
-      if (Debug) {
-        fprintf(stderr,
-                "mark %p (%s) at %p (%s)\n",
-                result,
-                segment(c, result),
-                p,
-                segment(c, p));
-      }
+  for (unsigned count = 1; c->markStack.size; ++count) {
+    Walker w(c, pop(&(c->markStack)));
+    c->client->walk(w.p, &w);
 
-      map->set(p);
+    if (deadline and count % IncrementSize == 0
+        and c->system->now() >= deadline) {
+      return false;
     }
   }
+
+  return true;
 }
 
-void* update(Context* c,
-             void** p,
-             void* target,
-             unsigned offset,
-             bool* needsVisit)
+void untrace(Context* c)
 {
-  if (maskAlignedPointer(*p) == 0) {
-    *needsVisit = false;
-    return 0;
+  while (c->tracedFixies.size) {
+    static_cast<Fixie*>(pop(&(c->tracedFixies)))->traced(false);
   }
+}
 
-  void* result = update2(c, maskAlignedPointer(*p), needsVisit);
-
-  if (result) {
-    updateHeapMap(c, p, target, offset, result);
+void startMarking(Context* c)
+{
+  if (Verbose) {
+    fprintf(stderr, "start marking gen2\n");
   }
 
-  return result;
+  c->phase = Marking;
+  c->remarkPending = false;
 }
 
-const uintptr_t BitsetExtensionBit
-    = (static_cast<uintptr_t>(1) << (BitsPerWord - 1));
+void abortMarking(Context* c)
+{
+  if (c->phase != Idle) {
+    memset(c->markMap.data, 0, c->markMap.size() * BytesPerWord);
+    c->markStack.size = 0;
+    untrace(c);
 
-void bitsetInit(uintptr_t* p)
+    c->phase = Idle;
+    c->remarkPending = false;
+  }
+}
+
+void resetFreeList(Context* c)
 {
-  memset(p, 0, BytesPerWord);
+  c->freeList = 0;
+  c->lastFreeChunk = 0;
+  c->gen2Free = 0;
 }
 
-void bitsetClear(uintptr_t* p, unsigned start, unsigned end)
+void freeRange(Context* c, unsigned start, unsigned end)
 {
-  if (end < BitsPerWord - 1) {
-    // do nothing
-  } else if (start < BitsPerWord - 1) {
-    memset(p + 1, 0, (wordOf(end + (BitsPerWord * 2) + 1)) * BytesPerWord);
-  } else {
-    unsigned startWord = wordOf(start + (BitsPerWord * 2) + 1);
-    unsigned endWord = wordOf(end + (BitsPerWord * 2) + 1);
-    if (endWord > startWord) {
-      memset(p + startWord + 1, 0, (endWord - startWord) * BytesPerWord);
+  clearRange(c, &(c->heapMap), start, end);
+
+  if (end - start >= MinimumFreeChunkInWords) {
+    FreeChunk* chunk = static_cast<FreeChunk*>(c->gen2.get(start));
+    chunk->size = end - start;
+    chunk->next = 0;
+
+    if (c->lastFreeChunk) {
+      c->lastFreeChunk->next = chunk;
+    } else {
+      c->freeList = chunk;
     }
+    c->lastFreeChunk = chunk;
+
+    c->gen2Free += chunk->size;
   }
 }
 
-void bitsetSet(uintptr_t* p, unsigned i, bool v)
+// lets the OS reclaim whole pages between the specified addresses
+unsigned releasePages(void* start, void* end)
 {
-  if (i >= BitsPerWord - 1) {
-    i += (BitsPerWord * 2) + 1;
-    if (v) {
-      p[0] |= BitsetExtensionBit;
-      if (p[2] <= wordOf(i) - 3)
+  uintptr_t mask = Memory::PageSize - 1;
+  uintptr_t first = (reinterpret_cast<uintptr_t>(start) + mask) & ~mask;
+  uintptr_t last = reinterpret_cast<uintptr_t>(end) & ~mask;
+  if (first < last) {
+    Memory::release(
+        Slice<uint8_t>(reinterpret_cast<uint8_t*>(first), last - first));
+    return last - first;
+  } else {
+    return 0;
+  }
+}
+
+// gives the memory behind large free chunks and the unused end of
+// gen2 back to the OS if more of gen2 is free than the client would
+// like.  We can't shrink gen2 without copying it, but this has much
+// the same effect on the footprint of the process.
+void releaseFree(Context* c)
+{
+  uint64_t free = c->gen2.remaining() + c->gen2Free;
+  if (free * 100
+      <= static_cast<uint64_t>(c->gen2.capacity()) * c->maximumFreePercent) {
+    return;
+  }
+
+  unsigned released = 0;
+  for (FreeChunk* chunk = c->freeList; chunk; chunk = chunk->next) {
+    if (chunk->size * BytesPerWord >= MinimumReleasedChunkInBytes) {
+      released += releasePages(
+          chunk + 1, reinterpret_cast<uintptr_t*>(chunk) + chunk->size);
+    }
+  }
+
+  released += releasePages(c->gen2.data + c->gen2.position(),
+                           c->gen2.data + c->gen2.capacity());
+
+  if (Verbose) {
+    fprintf(stderr, "released %d bytes of gen2\n", released);
+  }
+}
+
+// adds the space between marked objects to the free list until the
+// sweep is complete or the deadline (if any) has passed, returning
+// true in the former case
+bool sweep(Context* c, int64_t deadline)
+{
+  for (unsigned count = 1;; ++count) {
+    unsigned i = nextBit(c->markMap.data, c->sweepPosition, c->sweepEnd);
+    if (i == c->sweepEnd) {
+      break;
+    }
+
+    clearBit(c->markMap.data, i);
+
+    if (i > c->sweepPosition) {
+      freeRange(c, c->sweepPosition, i);
+    }
+
+    c->sweepPosition = i + c->client->sizeInWords(c->gen2.get(i));
+
+    if (deadline and count % IncrementSize == 0
+        and c->system->now() >= deadline) {
+      return false;
+    }
+  }
+
+  if (c->sweepPosition < c->sweepEnd) {
+    if (c->sweepEnd == c->gen2.position()) {
+      // nothing has been tenured at the end of gen2 since marking
+      // finished, so we can simply give the space back:
+      clearRange(c, &(c->heapMap), c->sweepPosition, c->sweepEnd);
+      c->gen2.position_ = c->sweepPosition;
+    } else {
+      freeRange(c, c->sweepPosition, c->sweepEnd);
+    }
+  }
+
+  if (Verbose) {
+    fprintf(stderr,
+            "finished sweeping gen2: %d bytes free\n",
+            (c->gen2.remaining() + c->gen2Free) * BytesPerWord);
+  }
+
+  // if most of gen2 is still live, the next major collection should
+  // copy it to a bigger segment:
+  c->growGen2 = c->gen2.remaining() + c->gen2Free < c->gen2.capacity() / 4;
+
+  releaseFree(c);
+
+  c->phase = Idle;
+
+  return true;
+}
+
+// allocates space from the first free chunk big enough to hold an
+// object of the specified size, if any
+void* allocateFree(Context* c, unsigned size)
+{
+  FreeChunk* previous = 0;
+  unsigned probes = 0;
+  for (FreeChunk** p = &(c->freeList); *p and probes < MaximumFreeChunkProbes;
+       p = &((*p)->next), ++probes) {
+    FreeChunk* chunk = *p;
+    if (chunk->size >= size) {
+      FreeChunk* next = chunk->next;
+      unsigned rest = chunk->size - size;
+
+      c->gen2Free -= chunk->size;
+
+      if (rest >= MinimumFreeChunkInWords) {
+        FreeChunk* remainder = reinterpret_cast<FreeChunk*>(
+            reinterpret_cast<uintptr_t*>(chunk) + size);
+        remainder->size = rest;
+        remainder->next = next;
+        *p = remainder;
+
+        c->gen2Free += rest;
+
+        if (c->lastFreeChunk == chunk) {
+          c->lastFreeChunk = remainder;
+        }
+      } else {
+        *p = next;
+
+        if (c->lastFreeChunk == chunk) {
+          c->lastFreeChunk = previous;
+        }
+      }
+
+      unsigned i = c->gen2.indexOf(chunk);
+      markBit(c->freshMap.data, i);
+      c->freshStart = min(c->freshStart, i);
+      c->freshEnd = max(c->freshEnd, i + 1);
+
+      return chunk;
+    }
+    previous = chunk;
+  }
+
+  return 0;
+}
+
+// allocates space for an object being tenured, using a free chunk if
+// possible, or else the end of gen2
+void* allocateGen2(Context* c, unsigned size)
+{
+  void* p = allocateFree(c, size);
+  if (p) {
+    return p;
+  }
+
+  if (c->gen2.remaining() >= size) {
+    if (c->gen2Base == Top) {
+      c->gen2Base = c->gen2.position();
+    }
+
+    return c->gen2.allocate(size);
+  }
+
+  return 0;
+}
+
+// moves the specified object out of the evacuation window into a
+// free chunk below it, returning the copy, or null if there is no
+// room for it
+void* evacuate(Context* c, void* o)
+{
+  void* dst = allocateFree(c, c->client->copiedSizeInWords(o));
+  if (dst) {
+    c->client->copy(o, dst);
+    markBit(c->markMap.data, c->gen2.indexOf(dst));
+
+    unsigned i = c->gen2.indexOf(o);
+    markBit(c->freshMap.data, i);
+    c->freshStart = min(c->freshStart, i);
+    c->freshEnd = max(c->freshEnd, i + 1);
+
+    fieldAtOffset<void*>(o, 0) = dst;
+  }
+
+  return dst;
+}
+
+// picks the part of gen2 to evacuate during an in-place major
+// collection.  Assuming the top of gen2 is still about as sparse as it
+// was when we last swept it, the free chunks below a region no bigger
+// than the total free space should hold whatever is live in it.
+// Anything tenured so far in this collection must stay below it.
+void openWindow(Context* c)
+{
+  unsigned end = c->gen2Base == Top ? c->gen2.position() : c->gen2Base;
+  unsigned free = 0;
+  for (FreeChunk* chunk = c->freeList; chunk; chunk = chunk->next) {
+    unsigned start = c->gen2.indexOf(chunk) + chunk->size;
+    free += chunk->size;
+
+    if (start >= c->freshEnd and end - start <= c->gen2Free) {
+      if (start < end) {
+        if (Verbose) {
+          fprintf(stderr,
+                  "evacuate up to %d bytes from the top of gen2\n",
+                  (end - start) * BytesPerWord);
+        }
+
+        // chunks in the window itself can't be used:
+        chunk->next = 0;
+        c->lastFreeChunk = chunk;
+        c->gen2Free = free;
+
+        c->windowStart = start;
+        c->windowEnd = end;
+      }
+      break;
+    }
+  }
+}
+
+// clears the remembered set for the space left behind by evacuated
+// objects, which we may have used as scratch space while visiting
+// their copies, along with any garbage after each of them
+void closeWindow(Context* c)
+{
+  unsigned end = c->windowEnd;
+  for (unsigned i = nextBit(c->freshMap.data, c->windowStart, end); i < end;) {
+    unsigned next = nextBit(c->freshMap.data, i + 1, end);
+    clearRange(c,
+               &(c->heapMap),
+               i,
+               min(next, nextBit(c->markMap.data, i + 1, end)));
+    i = next;
+  }
+
+  c->windowStart = Top;
+  c->windowEnd = 0;
+}
+
+void clearFresh(Context* c)
+{
+  if (c->freshStart != Top) {
+    clearRange(c->freshMap.data, c->freshStart, c->freshEnd);
+    c->freshStart = Top;
+    c->freshEnd = 0;
+  }
+}
+
+unsigned siteIndex(uintptr_t site)
+{
+  return (static_cast<uint32_t>(site / BytesPerWord) * 2654435761U)
+         >> (32 - PretenureSiteBits);
+}
+
+// copies the specified object to a free chunk or the end of gen2
+// during a collection which is not copying gen2, returning the copy, or
+// null if there is no room for it
+void* tenure(Context* c, void* o, unsigned size)
+{
+  void* dst = allocateGen2(c, size);
+  if (dst) {
+    c->client->copy(o, dst);
+
+    if (c->phase == Marking) {
+      markBit(c->markMap.data, c->gen2.indexOf(dst));
+    }
+  }
+
+  return dst;
+}
+
+// during the first half of a sample we measure what each site has
+// copied out of the nursery, and during the second half how much of
+// that is tenured, since the halves are as long as it takes an
+// object to reach the tenure threshold:
+inline bool sampleHalf(Context* c, bool second)
+{
+  return c->pretenureSampling
+         and (c->pretenureCountdown <= c->tenureThreshold + 1) == second;
+}
+
+void sampleTenured(Context* c, void* o, unsigned size)
+{
+  if (sampleHalf(c, true)) {
+    uintptr_t site = c->client->site(o);
+    if (site) {
+      c->siteTenuredFootprint[siteIndex(site)] += size;
+    }
+  }
+}
+
+void* copy2(Context* c, void* o)
+{
+  unsigned size = c->client->copiedSizeInWords(o);
+
+  if (c->gen2.contains(o)) {
+    assertT(c, c->mode == Heap::MajorCollection);
+
+    return copyTo(c, &(c->nextGen2), o, size);
+  } else if (c->gen1.contains(o)) {
+    unsigned age = c->ageMap.get(o);
+    if (age >= c->tenureThreshold) {
+      if (not copyingGen2(c)) {
+        void* dst = tenure(c, o, size);
+        if (dst) {
+          sampleTenured(c, o, size);
+
+          c->tenuredGen1Footprint += size;
+
+          return dst;
+        }
+
+        // there's no room in gen2 right now, so leave the object in
+        // gen1 and try again next time:
+        o = copyTo(c, &(c->nextGen1), o, size);
+
+        c->nextAgeMap.setOnly(o, age);
+        c->ageFootprint[age] += size;
+        c->tenureFootprint += size;
+
+        return o;
+      } else {
+        sampleTenured(c, o, size);
+
+        c->tenuredGen1Footprint += size;
+
+        return copyTo(c, &(c->nextGen2), o, size);
+      }
+    } else {
+      o = copyTo(c, &(c->nextGen1), o, size);
+
+      c->nextAgeMap.setOnly(o, age + 1);
+      c->ageFootprint[age + 1] += size;
+      if (age + 1 == c->tenureThreshold) {
+        c->tenureFootprint += size;
+      }
+
+      return o;
+    }
+  } else {
+    assertT(c, not c->nextGen1.contains(o));
+    assertT(c, not c->nextGen2.contains(o));
+    assertT(c, not immortalHeapContains(c, o));
+
+    uintptr_t site = c->pretenuring ? c->client->site(o) : 0;
+    if (site) {
+      unsigned i = siteIndex(site);
+      if (c->pretenureSampling) {
+        if (sampleHalf(c, false)) {
+          c->siteFootprint[i] += size;
+        }
+      } else if (getBit(c->pretenuredSites, i) and not copyingGen2(c)) {
+        void* dst = tenure(c, o, size);
+        if (dst) {
+          return dst;
+        }
+      }
+    }
+
+    o = copyTo(c, &(c->nextGen1), o, size);
+
+    c->nextAgeMap.clear(o);
+    c->ageFootprint[0] += size;
+
+    return o;
+  }
+}
+
+void* copy(Context* c, void* o)
+{
+  void* r = copy2(c, o);
+
+  if (Debug) {
+    fprintf(stderr,
+            "copy %p (%s) to %p (%s)\n",
+            o,
+            segment(c, o),
+            r,
+            segment(c, r));
+  }
+
+  // leave a pointer to the copy in the original
+  fieldAtOffset<void*>(o, 0) = r;
+
+  return r;
+}
+
+void* update3(Context* c, void* o, bool* needsVisit)
+{
+  if (c->client->isFixed(o)) {
+    Fixie* f = fixie(o);
+    if ((not f->marked())
+        and (copyingGen2(c) or f->age < FixieTenureThreshold)) {
+      if (DebugFixies) {
+        fprintf(stderr, "mark fixie %p\n", f);
+      }
+      f->marked(true);
+      f->dead(false);
+      f->move(c, &(c->markedFixies));
+    } else if (c->phase == Marking and f->age >= FixieTenureThreshold) {
+      shade(c, o);
+    }
+    *needsVisit = false;
+    return o;
+  } else if (immortalHeapContains(c, o)) {
+    *needsVisit = false;
+    return o;
+  } else if (wasCollected(c, o)) {
+    *needsVisit = false;
+    return follow(c, o);
+  } else {
+    *needsVisit = true;
+    return copy(c, o);
+  }
+}
+
+void* update2(Context* c, void* o, bool* needsVisit)
+{
+  if (c->gen2.contains(o) and not copyingGen2(c)) {
+    if (inWindow(c, o)) {
+      if (evacuated(c, o)) {
+        *needsVisit = false;
+        return follow(c, o);
+      } else if (not marked(c, o)) {
+        void* dst = evacuate(c, o);
+        if (dst) {
+          *needsVisit = true;
+          return dst;
+        }
+      }
+    }
+
+    if (c->phase == Marking) {
+      shade(c, o);
+    }
+
+    *needsVisit = false;
+    return o;
+  } else if (c->windowEnd and c->nextGen1.contains(o)) {
+    // the remembered set scan may already have updated the fields of
+    // an object before it was evacuated
+    *needsVisit = false;
+    return o;
+  }
+
+  return update3(c, o, needsVisit);
+}
+
+void markDirty(Context* c, Fixie* f)
+{
+  if (not f->dirty()) {
+#ifdef USE_ATOMIC_OPERATIONS
+    ACQUIRE(c->lock);
+#endif
+
+    if (not f->dirty()) {
+      f->dirty(true);
+      f->move(c, &(c->dirtyTenuredFixies));
+    }
+  }
+}
+
+void markClean(Context* c, Fixie* f)
+{
+  if (f->dirty()) {
+    f->dirty(false);
+    if (f->immortal()) {
+      f->remove(c);
+    } else {
+      f->move(c, &(c->tenuredFixies));
+    }
+  }
+}
+
+void updateHeapMap(Context* c,
+                   void* p,
+                   void* target,
+                   unsigned offset,
+                   void* result)
+{
+  Segment* seg;
+  Segment::Map* map;
+
+  if (copyingGen2(c)) {
+    seg = &(c->nextGen2);
+    map = &(c->nextHeapMap);
+  } else {
+    seg = &(c->gen2);
+    map = &(c->heapMap);
+  }
+
+  if (not(immortalHeapContains(c, result)
+          or (c->client->isFixed(result)
+              and fixie(result)->age >= FixieTenureThreshold)
+          or seg->contains(result))) {
+    if (target and c->client->isFixed(target)) {
+      Fixie* f = fixie(target);
+      assertT(c, offset == 0 or f->hasMask());
+
+      if (static_cast<unsigned>(f->age + 1) >= FixieTenureThreshold) {
+        if (DebugFixies) {
+          fprintf(stderr,
+                  "dirty fixie %p at %d (%p): %p\n",
+                  f,
+                  offset,
+                  f->body() + offset,
+                  result);
+        }
+
+        f->dirty(true);
+        markBit(f->mask(), offset);
+      }
+    } else if (seg->contains(p)) {
+      if (Debug) {
+        fprintf(stderr,
+                "mark %p (%s) at %p (%s)\n",
+                result,
+                segment(c, result),
+                p,
+                segment(c, p));
+      }
+
+      map->set(p);
+    }
+  }
+}
+
+void* update(Context* c,
+             void** p,
+             void* target,
+             unsigned offset,
+             bool* needsVisit)
+{
+  if (maskAlignedPointer(*p) == 0) {
+    *needsVisit = false;
+    return 0;
+  }
+
+  void* result = update2(c, maskAlignedPointer(*p), needsVisit);
+
+  if (result) {
+    updateHeapMap(c, p, target, offset, result);
+  }
+
+  return result;
+}
+
+const uintptr_t BitsetExtensionBit
+    = (static_cast<uintptr_t>(1) << (BitsPerWord - 1));
+
+void bitsetInit(uintptr_t* p)
+{
+  memset(p, 0, BytesPerWord);
+}
+
+void bitsetClear(uintptr_t* p, unsigned start, unsigned end)
+{
+  if (end < BitsPerWord - 1) {
+    // do nothing
+  } else if (start < BitsPerWord - 1) {
+    memset(p + 1, 0, (wordOf(end + (BitsPerWord * 2) + 1)) * BytesPerWord);
+  } else {
+    unsigned startWord = wordOf(start + (BitsPerWord * 2) + 1);
+    unsigned endWord = wordOf(end + (BitsPerWord * 2) + 1);
+    if (endWord > startWord) {
+      memset(p + startWord + 1, 0, (endWord - startWord) * BytesPerWord);
+    }
+  }
+}
+
+void bitsetSet(uintptr_t* p, unsigned i, bool v)
+{
+  if (i >= BitsPerWord - 1) {
+    i += (BitsPerWord * 2) + 1;
+    if (v) {
+      p[0] |= BitsetExtensionBit;
+      if (p[2] <= wordOf(i) - 3)
         p[2] = wordOf(i) - 2;
     }
   }
@@ -1363,8 +2253,88 @@ unsigned bitsetNext(Context* c, uintptr_t* p)
   }
 }
 
+// an alternative to the pointer-reversing traversal below which keeps
+// the copies still to be visited on an explicit stack.  It needs
+// memory in proportion to the breadth of the graph where the other
+// needs none, but walks each object once instead of on each descent
+// and ascent, and batches its fields so we may prefetch the objects
+// they point to before updating them
+void collectByStack(Context* c, void** p, void* target, unsigned offset)
+{
+  assertT(c, c->scanStack.size == 0);
+
+  bool needsVisit;
+  void* copy = update(c, maskAlignedPointer(p), target, offset, &needsVisit);
+  local::set(p, copy);
+
+  if (not needsVisit) {
+    return;
+  }
+
+  class Walker : public Heap::Walker {
+   public:
+    Walker(Context* c, void* copy) : c(c), copy(copy), count(0)
+    {
+    }
+
+    virtual bool visit(unsigned offset)
+    {
+      PREFETCH(get(copy, offset));
+
+      offsets[count++] = offset;
+      if (count == TraversalBatchSize) {
+        flush();
+      }
+
+      return true;
+    }
+
+    void flush()
+    {
+      for (unsigned i = 0; i < count; ++i) {
+        unsigned offset = offsets[i];
+
+        bool needsVisit;
+        void* childCopy
+            = update(c, getp(copy, offset), copy, offset, &needsVisit);
+
+        local::set(copy, offset, childCopy);
+
+        if (needsVisit) {
+          push(c, &(c->scanStack), childCopy);
+        }
+      }
+
+      count = 0;
+    }
+
+    Context* c;
+    void* copy;
+    unsigned count;
+    unsigned offsets[TraversalBatchSize];
+  };
+
+  push(c, &(c->scanStack), copy);
+
+  while (c->scanStack.size) {
+    Walker walker(c, pop(&(c->scanStack)));
+
+    if (Debug) {
+      fprintf(stderr, "walk %p (%s)\n", walker.copy, segment(c, walker.copy));
+    }
+
+    c->client->walk(walker.copy, &walker);
+    walker.flush();
+  }
+}
+
 void collect(Context* c, void** p, void* target, unsigned offset)
 {
+  if (c->stackTraversal) {
+    collectByStack(c, p, target, offset);
+    return;
+  }
+
   void* original = maskAlignedPointer(*p);
   void* parent_ = 0;
 
@@ -1718,27 +2688,38 @@ void collect(Context* c,
 
 void collect2(Context* c)
 {
+  memcpy(c->lastAgeFootprint, c->ageFootprint, sizeof(c->ageFootprint));
+  memset(c->ageFootprint, 0, sizeof(c->ageFootprint));
+  c->tenuredGen1Footprint = 0;
+
   c->gen2Base = Top;
   c->tenureFootprint = 0;
   c->fixieTenureFootprint = 0;
   c->gen1Padding = 0;
   c->tenurePadding = 0;
 
-  if (c->mode == Heap::MajorCollection) {
+  if (copyingGen2(c)) {
     c->gen2Padding = 0;
   }
 
-  if (c->mode == Heap::MinorCollection and c->gen2.position()) {
+  if ((not copyingGen2(c)) and c->gen2.position()) {
     unsigned start = 0;
     unsigned end = start + c->gen2.position();
     bool dirty;
     collect(c, &(c->heapMap), start, end, &dirty, false);
   }
 
-  if (c->mode == Heap::MinorCollection) {
+  if (not copyingGen2(c)) {
     visitDirtyFixies(c, &(c->dirtyTenuredFixies));
   }
 
+  if (c->compacting) {
+    // we wait until now to pick the window since the remembered set
+    // scan reads objects field by field, and those we evacuate may be
+    // overwritten with scratch data as we visit their copies:
+    openWindow(c);
+  }
+
   class Visitor : public Heap::Visitor {
    public:
     Visitor(Context* c) : c(c)
@@ -1749,6 +2730,12 @@ void collect2(Context* c)
     {
       local::collect(c, static_cast<void**>(p));
       visitMarkedFixies(c);
+
+      if (c->inPlace) {
+        // the client may ask about the status of any object after
+        // this, so finish marking everything reachable so far:
+        drain(c, 0);
+      }
     }
 
     Context* c;
@@ -1757,10 +2744,160 @@ void collect2(Context* c)
   c->client->visitRoots(&v);
 }
 
+// returns true if the next major collection should mark and compact
+// gen2 in place rather than copy it, either because we've been asked
+// to or because there isn't enough memory left for a copy
+bool compactInPlace(Context* c)
+{
+  if (c->gen2.position() == 0) {
+    return false;
+  }
+
+  int64_t copy = static_cast<int64_t>(c->count) + c->pendingAllocation
+                 + (static_cast<int64_t>(
+                        c->gen1.footprint(minimumNextGen1Capacity(c))
+                        + c->gen2.footprint(minimumNextGen2Capacity(c)))
+                    * BytesPerWord);
+
+  return copy > c->limit or (c->compaction and not c->growGen2);
+}
+
+// moves the tenure threshold toward the age at which objects tend to
+// live on indefinitely, based on how many of those which reached the
+// threshold last time survived this collection
+void adjustTenureThreshold(Context* c, int64_t pause)
+{
+  if (c->fixedTenureThreshold) {
+    return;
+  }
+
+  unsigned threshold = c->tenureThreshold;
+
+  unsigned cohort = 0;
+  for (unsigned i = threshold; i <= MaximumTenureThreshold; ++i) {
+    cohort += c->lastAgeFootprint[i];
+  }
+
+  if (c->mode == Heap::MinorCollection and c->pauseGoal
+      and pause > c->pauseGoal) {
+    // copying objects within gen1 is most of the work of a minor
+    // collection, so tenure them sooner:
+    threshold = max(threshold - 1, 1);
+  } else if (cohort * BytesPerWord >= MinimumCohortInBytes) {
+    if (c->tenuredGen1Footprint * 10 >= cohort * 9) {
+      // nearly all of them survived, so we're copying them for nothing
+      threshold = max(threshold - 1, 1);
+    } else if (c->tenuredGen1Footprint * 2 < cohort) {
+      // most of them died, so we should have kept them in gen1
+      threshold = min(threshold + 1, MaximumTenureThreshold);
+    }
+  }
+
+  if (threshold != c->tenureThreshold) {
+    if (Verbose) {
+      fprintf(stderr,
+              "tenure threshold %d -> %d\n",
+              c->tenureThreshold,
+              threshold);
+    }
+
+    c->tenureThreshold = threshold;
+
+    // revise our estimate of what will be tenured next time:
+    c->tenureFootprint = 0;
+    for (unsigned i = threshold; i <= MaximumTenureThreshold; ++i) {
+      c->tenureFootprint += c->ageFootprint[i];
+    }
+  }
+}
+
+// alternates between sampling how much of what each allocation site
+// produces is tenured, for long enough that objects may reach the
+// tenure threshold, and pretenuring the sites which tenure nearly
+// everything, so the next sample can notice if that changes
+void adjustPretenuring(Context* c)
+{
+  if (not c->pretenuring) {
+    return;
+  }
+
+  if (c->pretenureCountdown and --c->pretenureCountdown) {
+    return;
+  }
+
+  if (c->pretenureSampling) {
+    memset(c->pretenuredSites, 0, sizeof(c->pretenuredSites));
+
+    unsigned count = 0;
+    for (unsigned i = 0; i < PretenureSiteCount; ++i) {
+      unsigned footprint = c->siteFootprint[i];
+      if (footprint * BytesPerWord >= MinimumSiteFootprintInBytes
+          and c->siteTenuredFootprint[i] * 10 >= footprint * 9) {
+        markBit(c->pretenuredSites, i);
+        ++count;
+      }
+    }
+
+    if (Verbose) {
+      fprintf(stderr, "pretenure %d sites\n", count);
+    }
+
+    c->pretenureSampling = false;
+    c->pretenureCountdown = PretenureHoldCollections;
+  } else {
+    memset(c->siteFootprint, 0, sizeof(c->siteFootprint));
+    memset(c->siteTenuredFootprint, 0, sizeof(c->siteTenuredFootprint));
+
+    c->pretenureSampling = true;
+    c->pretenureCountdown = 2 * (c->tenureThreshold + 1);
+  }
+}
+
+// grows the space the client may allocate between minor collections
+// if we are spending too much time collecting, and shrinks it if
+// minor collections are taking too long
+void adjustIncomingLimit(Context* c, int64_t now, int64_t pause)
+{
+  c->goalCollectionTime += pause;
+  if (c->mode == Heap::MinorCollection) {
+    c->maximumPause = max(c->maximumPause, static_cast<unsigned>(pause));
+  }
+
+  int64_t interval = now - c->goalStartTime;
+  if (interval >= GoalIntervalInMilliseconds) {
+    unsigned limit = c->incomingLimit;
+
+    if (c->pauseGoal and c->maximumPause > c->pauseGoal) {
+      limit = max(limit / 2,
+                  min(MinimumIncomingLimitInBytes, c->limit / 8));
+    } else if (c->overheadGoal
+               and c->goalCollectionTime * 100 > interval * c->overheadGoal) {
+      limit = min(
+          limit * 2,
+          max(min(c->limit / 8, MaximumIncomingLimitInBytes), limit));
+    }
+
+    if (limit != c->incomingLimit) {
+      if (Verbose) {
+        fprintf(stderr,
+                "incoming limit %d -> %d bytes\n",
+                c->incomingLimit,
+                limit);
+      }
+
+      c->incomingLimit = limit;
+    }
+
+    c->goalStartTime = now;
+    c->goalCollectionTime = 0;
+    c->maximumPause = 0;
+  }
+}
+
 bool limitExceeded(Context* c, int pendingAllocation)
 {
   unsigned count = c->count + pendingAllocation
-                   - (c->gen2.remaining() * BytesPerWord);
+                   - ((c->gen2.remaining() + c->gen2Free) * BytesPerWord);
 
   if (Verbose) {
     if (count > c->limit) {
@@ -1780,59 +2917,160 @@ bool limitExceeded(Context* c, int pendingAllocation)
 
 void collect(Context* c)
 {
-  if (limitExceeded(c, c->pendingAllocation) or oversizedGen2(c)
-      or c->tenureFootprint + c->tenurePadding > c->gen2.remaining()
-      or c->fixieTenureFootprint + c->tenuredFixieFootprint
-         > c->tenuredFixieCeiling) {
+  // with a pause budget, gen2 is marked and swept in small steps
+  // during minor collections instead of being copied all at once,
+  // unless we run out of room first:
+  bool incremental = c->pauseBudget and c->mode == Heap::MinorCollection;
+  int64_t deadline = incremental ? c->system->now() + c->pauseBudget : 0;
+
+  bool undersized = c->tenureFootprint + c->tenurePadding
+                    > c->gen2.remaining() + c->gen2Free;
+
+  if (incremental and undersized and c->phase != Idle) {
+    // rather than copying gen2, we finish the cycle in progress early
+    // and leave whatever doesn't fit in gen1 for now:
+    if (c->phase == Marking) {
+      c->remarkPending = true;
+    } else {
+      deadline = 0;
+    }
+    undersized = false;
+  }
+
+  // tenured fixies are only reclaimed when gen2 is copied:
+  bool fixieCeiling = c->fixieTenureFootprint + c->tenuredFixieFootprint
+                      > c->tenuredFixieCeiling;
+
+  // when compacting gen2 in place, we collect it before it fills up
+  // so there is still room to evacuate objects into:
+  bool crowded = c->compaction and c->phase == Idle and not c->growGen2
+                 and c->gen2.remaining() + c->gen2Free
+                     < c->gen2.capacity() / 4;
+
+  if (limitExceeded(c, c->pendingAllocation)
+      or ((not incremental) and oversizedGen2(c)) or undersized
+      or fixieCeiling or crowded) {
     if (Verbose) {
       if (limitExceeded(c, c->pendingAllocation)) {
         fprintf(stderr, "low memory causes ");
-      } else if (oversizedGen2(c)) {
+      } else if ((not incremental) and oversizedGen2(c)) {
         fprintf(stderr, "oversized gen2 causes ");
-      } else if (c->tenureFootprint + c->tenurePadding > c->gen2.remaining()) {
+      } else if (undersized) {
         fprintf(stderr, "undersized gen2 causes ");
-      } else {
+      } else if (fixieCeiling) {
         fprintf(stderr, "fixie ceiling causes ");
+      } else {
+        fprintf(stderr, "crowded gen2 causes ");
       }
     }
 
     c->mode = Heap::MajorCollection;
   }
 
-  int64_t then;
+  c->inPlace = false;
+
+  if (c->mode == Heap::MajorCollection) {
+    abortMarking(c);
+
+    if ((not fixieCeiling) and compactInPlace(c) and acquireBitmaps(c)) {
+      // mark gen2 in place and evacuate what we can from the top of
+      // it into the free chunks below, instead of copying all of it
+      // to nextGen2:
+      if (Verbose) {
+        fprintf(stderr, "compact gen2 in place\n");
+      }
+
+      startMarking(c);
+      c->inPlace = true;
+      c->compacting = true;
+    } else {
+      resetFreeList(c);
+      releaseBitmaps(c);
+      c->growGen2 = false;
+    }
+  } else if (incremental) {
+    if (c->remarkPending) {
+      // marking has caught up with the mutator, so we finish it in
+      // this collection and then sweep gen2 in place:
+      c->mode = Heap::MajorCollection;
+      c->inPlace = true;
+    } else if (c->phase == Idle
+               and c->gen2.remaining() + c->gen2Free < c->gen2.capacity() / 2
+               and acquireBitmaps(c)) {
+      startMarking(c);
+    }
+  }
+
   if (Verbose) {
     if (c->mode == Heap::MajorCollection) {
       fprintf(stderr, "major collection\n");
     } else {
       fprintf(stderr, "minor collection\n");
     }
-
-    then = c->system->now();
   }
 
+  int64_t then = c->system->now();
+
   initNextGen1(c);
 
-  if (c->mode == Heap::MajorCollection) {
+  if (copyingGen2(c)) {
     initNextGen2(c);
   }
 
   collect2(c);
 
+  if (c->inPlace) {
+    drain(c, 0);
+  }
+
   c->gen1.replaceWith(&(c->nextGen1));
-  if (c->mode == Heap::MajorCollection) {
+  if (copyingGen2(c)) {
     c->gen2.replaceWith(&(c->nextGen2));
   }
 
   sweepFixies(c);
 
-  if (Verbose) {
-    int64_t now = c->system->now();
-    int64_t collection = now - then;
-    int64_t run = then - c->lastCollectionTime;
-    c->totalCollectionTime += collection;
-    c->totalTime += collection + run;
-    c->lastCollectionTime = now;
+  if (c->compacting) {
+    closeWindow(c);
+    c->compacting = false;
+  }
+
+  clearFresh(c);
+
+  if (c->inPlace) {
+    untrace(c);
+
+    c->phase = Sweeping;
+    c->remarkPending = false;
+    c->sweepPosition = 0;
+    c->sweepEnd = c->gen2.position();
+    resetFreeList(c);
+  }
+
+  if (c->phase == Marking) {
+    if (drain(c, deadline)) {
+      c->remarkPending = true;
+    }
+  } else if (c->phase == Sweeping) {
+    sweep(c, deadline);
+  }
+
+  int64_t now = c->system->now();
+  int64_t collection = now - then;
+  int64_t run = then - c->lastCollectionTime;
+  c->totalCollectionTime += collection;
+  c->totalTime += collection + run;
+  c->lastCollectionTime = now;
+
+  adjustTenureThreshold(c, collection);
+  adjustPretenuring(c);
+  adjustIncomingLimit(c, now, collection);
+
+  if (c->mode == Heap::MajorCollection) {
+    releaseLargeCache(c);
+  }
 
+  if (Verbose) {
     fprintf(stderr,
             " - collect: %4dms; "
             "total: %4dms; "
@@ -1863,6 +3101,103 @@ void collect(Context* c)
   }
 }
 
+void* allocateBlock(Context* c, size_t size)
+{
+  if (c->hugePages and size >= Memory::HugePageSize) {
+    return Memory::allocate(size, Memory::ReadWrite, true).begin();
+  } else if (size >= MinimumMappedBlockInBytes) {
+    return Memory::allocate(pad(size, Memory::PageSize)).begin();
+  } else {
+    return c->system->tryAllocate(size);
+  }
+}
+
+void freeBlock(Context* c, const void* p, size_t size)
+{
+  if (c->hugePages and size >= Memory::HugePageSize) {
+    Memory::free(Slice<uint8_t>(
+        static_cast<uint8_t*>(const_cast<void*>(p)),
+        pad(size, Memory::HugePageSize)));
+  } else if (size >= MinimumMappedBlockInBytes) {
+    Memory::free(Slice<uint8_t>(
+        static_cast<uint8_t*>(const_cast<void*>(p)),
+        pad(size, Memory::PageSize)));
+  } else {
+    c->system->free(p);
+  }
+}
+
+// large objects each get a run of pages to themselves, rounded up to
+// one of a series of sizes at most 1/16 apart so that freed runs may
+// be reused for objects of similar size:
+unsigned largeBlockSize(unsigned size)
+{
+  unsigned pages = ceilingDivide(size, Memory::PageSize);
+  unsigned granularity = max(nextPowerOfTwo(pages) / 16, 1);
+  return pad(pages, granularity) * Memory::PageSize;
+}
+
+void* allocateLarge(Context* c, unsigned size)
+{
+  ACQUIRE(c->lock);
+
+  void* p = 0;
+  for (LargeBlock** b = &(c->largeFreeList); *b; b = &((*b)->next)) {
+    if ((*b)->size == size) {
+      p = *b;
+      *b = (*b)->next;
+      c->largeCacheFootprint -= size;
+      break;
+    }
+  }
+
+  if (p == 0) {
+    p = Memory::allocate(size).begin();
+    expect(c->system, p);
+  }
+
+  c->count += size;
+  c->largeFootprint += size;
+
+  return p;
+}
+
+void freeLarge(Context* c, void* p, unsigned size)
+{
+  ACQUIRE(c->lock);
+
+  expect(c->system, c->count >= size);
+
+  c->count -= size;
+  c->largeFootprint -= size;
+
+  if (c->largeCacheFootprint + size <= MaximumLargeCacheInBytes) {
+    // fresh mappings are zeroed by the OS, so clear cached blocks here
+    // to let allocateLarge promise the same of every block it returns:
+    memset(p, 0, size);
+
+    LargeBlock* b = static_cast<LargeBlock*>(p);
+    b->size = size;
+    b->next = c->largeFreeList;
+    c->largeFreeList = b;
+    c->largeCacheFootprint += size;
+  } else {
+    Memory::free(Slice<uint8_t>(static_cast<uint8_t*>(p), size));
+  }
+}
+
+void releaseLargeCache(Context* c)
+{
+  ACQUIRE(c->lock);
+
+  while (c->largeFreeList) {
+    LargeBlock* b = c->largeFreeList;
+    c->largeFreeList = b->next;
+    Memory::free(Slice<uint8_t>(reinterpret_cast<uint8_t*>(b), b->size));
+  }
+  c->largeCacheFootprint = 0;
+}
+
 void* allocate(Context* c, size_t size, bool limit)
 {
   ACQUIRE(c->lock);
@@ -1872,7 +3207,7 @@ void* allocate(Context* c, size_t size, bool limit)
   }
 
   if ((not limit) or size + c->count < c->limit) {
-    void* p = c->system->tryAllocate(size);
+    void* p = allocateBlock(c, size);
     if (p) {
       c->count += size;
 
@@ -1921,7 +3256,7 @@ void free(Context* c, const void* p, size_t size)
 
   expect(c->system, c->count >= size);
 
-  c->system->free(p);
+  freeBlock(c, p, size);
   c->count -= size;
 }
 
@@ -1948,11 +3283,71 @@ class MyHeap : public Heap {
     c.immortalHeapEnd = start + sizeInWords;
   }
 
+  virtual void setPauseBudget(unsigned milliseconds)
+  {
+    c.pauseBudget = milliseconds;
+  }
+
+  virtual void setCompaction(bool enabled)
+  {
+    c.compaction = enabled;
+  }
+
+  virtual void setPretenuring(bool enabled)
+  {
+    c.pretenuring = enabled;
+  }
+
+  virtual void setStackTraversal(bool enabled)
+  {
+    c.stackTraversal = enabled;
+  }
+
+  virtual void setTenureThreshold(unsigned threshold)
+  {
+    if (threshold) {
+      c.tenureThreshold = max(min(threshold, MaximumTenureThreshold), 1);
+      c.fixedTenureThreshold = true;
+    } else {
+      c.fixedTenureThreshold = false;
+    }
+  }
+
+  virtual void setPauseGoal(unsigned milliseconds)
+  {
+    c.pauseGoal = milliseconds;
+  }
+
+  virtual void setOverheadGoal(unsigned percent)
+  {
+    c.overheadGoal = percent;
+  }
+
+  virtual void setFreeRatio(unsigned minimumPercent, unsigned maximumPercent)
+  {
+    c.minimumFreePercent
+        = minimumPercent ? min(minimumPercent, 90) : DefaultMinimumFreePercent;
+
+    c.maximumFreePercent = max(
+        maximumPercent ? min(maximumPercent, 99) : DefaultMaximumFreePercent,
+        c.minimumFreePercent);
+  }
+
+  virtual void setHugePages(bool enabled)
+  {
+    c.hugePages = enabled;
+  }
+
   virtual unsigned remaining()
   {
     return c.limit - c.count;
   }
 
+  virtual unsigned incomingLimit()
+  {
+    return c.incomingLimit;
+  }
+
   virtual unsigned limit()
   {
     return c.limit;
@@ -2019,6 +3414,24 @@ class MyHeap : public Heap {
         allocator, sizeInWords, objectMask, &(c.fixies), false);
   }
 
+  virtual void* allocateLarge(unsigned sizeInWords, bool objectMask)
+  {
+    expect(&c, not limitExceeded());
+
+    void* p = local::allocateLarge(
+        &c, largeBlockSize(Fixie::totalSize(sizeInWords, objectMask)));
+
+    Fixie* f = new (p) Fixie(&c, sizeInWords, objectMask, &(c.fixies), false);
+    f->flags |= Fixie::Large;
+
+    return f->body();
+  }
+
+  virtual unsigned largeFootprint()
+  {
+    return c.largeFootprint;
+  }
+
   virtual void* allocateImmortalFixed(Alloc* allocator,
                                       unsigned sizeInWords,
                                       bool objectMask)
@@ -2046,6 +3459,23 @@ class MyHeap : public Heap {
                    and fixie(target)->age >= FixieTenureThreshold);
   }
 
+  void shadeTargets(void** p, unsigned count)
+  {
+    for (unsigned i = 0; i < count; ++i) {
+      void* o = maskAlignedPointer(p[i]);
+      if (o and ((c.gen2.contains(o) and not marked(&c, o))
+                 or (c.client->isFixed(o)
+                     and fixie(o)->age >= FixieTenureThreshold
+                     and not fixie(o)->traced()))) {
+#ifdef USE_ATOMIC_OPERATIONS
+        ACQUIRE(c.lock);
+#endif
+
+        shade(&c, o);
+      }
+    }
+  }
+
   virtual void mark(void* p, unsigned offset, unsigned count)
   {
     if (needsMark(p)) {
@@ -2053,6 +3483,13 @@ class MyHeap : public Heap {
       ACQUIRE(c.lock);
 #endif
 
+      if (c.phase == Marking) {
+        // gen2 is being marked incrementally, so make sure anything
+        // stored in an object which may already have been traced gets
+        // marked as well:
+        shadeTargets(static_cast<void**>(p) + offset, count);
+      }
+
       if (c.client->isFixed(p)) {
         Fixie* f = fixie(p);
         assertT(&c, offset == 0 or f->hasMask());
@@ -2108,7 +3545,7 @@ class MyHeap : public Heap {
   virtual void pad(void* p)
   {
     if (c.gen1.contains(p)) {
-      if (c.ageMap.get(p) == TenureThreshold) {
+      if (c.ageMap.get(p) >= c.tenureThreshold) {
         ++c.tenurePadding;
       } else {
         ++c.gen1Padding;
@@ -2124,6 +3561,10 @@ class MyHeap : public Heap {
   {
     if (p == 0 or c.client->isFixed(p)) {
       return p;
+    } else if (c.gen2.contains(p) and not copyingGen2(&c)) {
+      // gen2 objects only move when gen2 is copied, or when they are
+      // evacuated from the top of it
+      return evacuated(&c, p) ? local::follow(&c, p) : p;
     } else if (wasCollected(&c, p)) {
       if (Debug) {
         fprintf(stderr,
@@ -2159,9 +3600,11 @@ class MyHeap : public Heap {
                                             : Tenured);
     } else if (c.nextGen1.contains(p)) {
       return Reachable;
+    } else if (c.inPlace and c.gen2.contains(p)) {
+      return marked(&c, p) or evacuated(&c, p) ? Tenured : Unreachable;
     } else if (c.nextGen2.contains(p) or immortalHeapContains(&c, p)
                or (c.gen2.contains(p)
-                   and (c.mode == Heap::MinorCollection
+                   and ((not copyingGen2(&c))
                         or c.gen2.indexOf(p) >= c.gen2Base))) {
       return Tenured;
     } else if (wasCollected(&c, p)) {
@@ -472,24 +472,15 @@ void pushResult(Thread* t, unsigned returnCode, uint64_t result, bool indirect)
 
 void marshalArguments(Thread* t,
                       uintptr_t* args,
-                      uint8_t* types,
+                      const uint8_t* types,
+                      unsigned count,
                       unsigned sp,
-                      GcMethod* method,
                       bool fastCallingConvention)
 {
-  MethodSpecIterator it(
-      t, reinterpret_cast<const char*>(method->spec()->body().begin()));
-
   unsigned argOffset = 0;
-  unsigned typeOffset = 0;
-
-  while (it.hasNext()) {
-    unsigned type = fieldType(t, fieldCode(t, *it.next()));
-    if (types) {
-      types[typeOffset++] = type;
-    }
 
-    switch (type) {
+  for (unsigned i = 0; i < count; ++i) {
+    switch (types[i]) {
     case INT8_TYPE:
     case INT16_TYPE:
     case INT32_TYPE:
@@ -538,10 +529,9 @@ unsigned invokeNativeSlow(Thread* t, GcMethod* method, void* function)
   THREAD_RUNTIME_ARRAY(t, uintptr_t, args, footprint);
   unsigned argOffset = 0;
   THREAD_RUNTIME_ARRAY(t, uint8_t, types, count);
-  unsigned typeOffset = 0;
+  getNativeTypes(t, method, RUNTIME_ARRAY_BODY(types));
 
   RUNTIME_ARRAY_BODY(args)[argOffset++] = reinterpret_cast<uintptr_t>(t);
-  RUNTIME_ARRAY_BODY(types)[typeOffset++] = POINTER_TYPE;
 
   GcJclass* jclass = 0;
   PROTECT(t, jclass);
@@ -560,13 +550,12 @@ unsigned invokeNativeSlow(Thread* t, GcMethod* method, void* function)
     }
     RUNTIME_ARRAY_BODY(args)[argOffset++] = reinterpret_cast<uintptr_t>(v);
   }
-  RUNTIME_ARRAY_BODY(types)[typeOffset++] = POINTER_TYPE;
 
   marshalArguments(t,
                    RUNTIME_ARRAY_BODY(args) + argOffset,
-                   RUNTIME_ARRAY_BODY(types) + typeOffset,
+                   RUNTIME_ARRAY_BODY(types) + 2,
+                   count - 2,
                    sp,
-                   method,
                    false);
 
   unsigned returnCode = method->returnCode();
@@ -615,6 +604,83 @@ unsigned invokeNativeSlow(Thread* t, GcMethod* method, void* function)
   return returnCode;
 }
 
+unsigned invokeNativeCritical(Thread* t, GcMethod* method, void* function)
+{
+  PROTECT(t, method);
+
+  unsigned parameterCount = method->parameterCount();
+
+  THREAD_RUNTIME_ARRAY(t, uint8_t, parameterTypes, parameterCount + 2);
+  getNativeTypes(t, method, RUNTIME_ARRAY_BODY(parameterTypes));
+
+  pushFrame(t, method);
+
+  // each parameter occupies at most two words and two type slots,
+  // since arrays are passed as a length followed by a pointer:
+  THREAD_RUNTIME_ARRAY(t, uintptr_t, args, (parameterCount * 2) + 1);
+  unsigned argOffset = 0;
+  THREAD_RUNTIME_ARRAY(t, uint8_t, types, (parameterCount * 2) + 1);
+  unsigned typeOffset = 0;
+
+  unsigned sp = frameBase(t, t->frame);
+  for (unsigned i = 2; i < parameterCount + 2; ++i) {
+    unsigned type = RUNTIME_ARRAY_BODY(parameterTypes)[i];
+    switch (type) {
+    case INT8_TYPE:
+    case INT16_TYPE:
+    case INT32_TYPE:
+    case FLOAT_TYPE:
+      RUNTIME_ARRAY_BODY(types)[typeOffset++] = type;
+      RUNTIME_ARRAY_BODY(args)[argOffset++] = peekInt(t, sp++);
+      break;
+
+    case DOUBLE_TYPE:
+    case INT64_TYPE: {
+      RUNTIME_ARRAY_BODY(types)[typeOffset++] = type;
+      uint64_t v = peekLong(t, sp);
+      memcpy(RUNTIME_ARRAY_BODY(args) + argOffset, &v, 8);
+      argOffset += (8 / BytesPerWord);
+      sp += 2;
+    } break;
+
+    case POINTER_TYPE: {
+      uintptr_t* array = reinterpret_cast<uintptr_t*>(peekObject(t, sp++));
+      RUNTIME_ARRAY_BODY(types)[typeOffset++] = INT32_TYPE;
+      RUNTIME_ARRAY_BODY(args)[argOffset++] = array ? array[1] : 0;
+      RUNTIME_ARRAY_BODY(types)[typeOffset++] = POINTER_TYPE;
+      RUNTIME_ARRAY_BODY(args)[argOffset++]
+          = array ? reinterpret_cast<uintptr_t>(array + 2) : 0;
+    } break;
+
+    default:
+      abort(t);
+    }
+  }
+
+  unsigned returnCode = method->returnCode();
+
+  if (DebugRun) {
+    fprintf(stderr,
+            "invoke critical native method %s.%s\n",
+            method->class_()->name()->body().begin(),
+            method->name()->body().begin());
+  }
+
+  // see invokeNativeCritical in compile.cpp
+  uint64_t result = vm::dynamicCall(function,
+                                    RUNTIME_ARRAY_BODY(args),
+                                    RUNTIME_ARRAY_BODY(types),
+                                    typeOffset,
+                                    argOffset * BytesPerWord,
+                                    fieldType(t, returnCode));
+
+  popFrame(t);
+
+  pushResult(t, returnCode, result, false);
+
+  return returnCode;
+}
+
 unsigned invokeNative(Thread* t, GcMethod* method)
 {
   PROTECT(t, method);
@@ -623,6 +689,12 @@ unsigned invokeNative(Thread* t, GcMethod* method)
 
   GcNative* native = getMethodRuntimeData(t, method)->native();
   if (native->fast()) {
+    PROTECT(t, native);
+
+    unsigned count = method->parameterCount() + 2;
+    THREAD_RUNTIME_ARRAY(t, uint8_t, types, count);
+    getNativeTypes(t, method, RUNTIME_ARRAY_BODY(types));
+
     pushFrame(t, method);
 
     uint64_t result;
@@ -638,8 +710,12 @@ unsigned invokeNative(Thread* t, GcMethod* method)
             = reinterpret_cast<uintptr_t>(peekObject(t, sp++));
       }
 
-      marshalArguments(
-          t, RUNTIME_ARRAY_BODY(args) + argOffset, 0, sp, method, true);
+      marshalArguments(t,
+                       RUNTIME_ARRAY_BODY(args) + argOffset,
+                       RUNTIME_ARRAY_BODY(types) + 2,
+                       count - 2,
+                       sp,
+                       true);
 
       if(method->returnCode() != VoidField) {
         result = reinterpret_cast<FastNativeFunction>(native->function())(
@@ -655,6 +731,8 @@ unsigned invokeNative(Thread* t, GcMethod* method)
     pushResult(t, method->returnCode(), result, false);
 
     return method->returnCode();
+  } else if (native->critical()) {
+    return invokeNativeCritical(t, method, native->function());
   } else {
     return invokeNativeSlow(t, method, native->function());
   }
@@ -3518,6 +3596,19 @@ class MyProcessor : public Processor {
     abort(s);
   }
 
+  virtual void compileMethods(vm::Thread*,
+                              Zone**,
+                              unsigned,
+                              GcTriple**,
+                              GcTriple**,
+                              avian::codegen::DelayedPromise**,
+                              GcArray*,
+                              OffsetResolver*,
+                              JavaVM*)
+  {
+    abort(s);
+  }
+
   virtual void visitRoots(vm::Thread*, HeapWalker*)
   {
     abort(s);
@@ -3592,6 +3683,7 @@ namespace vm {
 Processor* makeProcessor(System* system,
                          Allocator* allocator,
                          const char* crashDumpDirectory,
+                         bool,
                          bool)
 {
   return new (allocator->allocate(sizeof(local::MyProcessor)))
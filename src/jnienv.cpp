@@ -169,34 +169,38 @@ void JNICALL
   stringChars(t, *s, start, length, dst);
 }
 
+// Unlike most implementations, we don't keep the calling thread in the
+// active state (and thus block garbage collection) for the duration of
+// a critical region.  Instead, we return a direct pointer if the array
+// in question is fixed (i.e. it was large enough to be allocated
+// outside the young generation and will never move), and a copy
+// otherwise.  Since movable arrays are small, the copy is cheap.
+
 const jchar* JNICALL GetStringCritical(Thread* t, jstring s, jboolean* isCopy)
 {
-  if (t->criticalLevel == 0) {
-    enter(t, Thread::ActiveState);
-  }
-
-  ++t->criticalLevel;
-
-  if (isCopy) {
-    *isCopy = true;
-  }
+  ENTER(t, Thread::ActiveState);
 
   object data = (*s)->data();
-  if (objectClass(t, data) == type(t, GcByteArray::Type)) {
-    return GetStringChars(t, s, isCopy);
-  } else {
+  if (objectClass(t, data) == type(t, GcCharArray::Type)
+      and objectFixed(t, data)) {
+    if (isCopy) {
+      *isCopy = false;
+    }
+
     return &cast<GcCharArray>(t, data)->body()[(*s)->offset(t)];
+  } else {
+    return GetStringChars(t, s, isCopy);
   }
 }
 
 void JNICALL ReleaseStringCritical(Thread* t, jstring s, const jchar* chars)
 {
-  if (objectClass(t, (*s)->data()) == type(t, GcByteArray::Type)) {
-    ReleaseStringChars(t, s, chars);
-  }
+  ENTER(t, Thread::ActiveState);
 
-  if ((--t->criticalLevel) == 0) {
-    enter(t, Thread::IdleState);
+  object data = (*s)->data();
+  if (objectClass(t, data) != type(t, GcCharArray::Type)
+      or chars != &cast<GcCharArray>(t, data)->body()[(*s)->offset(t)]) {
+    ReleaseStringChars(t, s, chars);
   }
 }
 
@@ -2970,28 +2974,59 @@ void JNICALL SetDoubleArrayRegion(Thread* t,
   }
 }
 
+// see the comment preceding GetStringCritical above
 void* JNICALL
     GetPrimitiveArrayCritical(Thread* t, jarray array, jboolean* isCopy)
 {
-  if (t->criticalLevel == 0) {
-    enter(t, Thread::ActiveState);
-  }
+  ENTER(t, Thread::ActiveState);
 
-  ++t->criticalLevel;
+  expect(t, *array);
 
-  if (isCopy) {
-    *isCopy = true;
-  }
+  void* body = reinterpret_cast<uintptr_t*>(*array) + 2;
 
-  expect(t, *array);
+  if (objectFixed(t, *array)) {
+    if (isCopy) {
+      *isCopy = false;
+    }
+
+    return body;
+  } else {
+    unsigned size = fieldAtOffset<uintptr_t>(*array, BytesPerWord)
+                    * objectClass(t, *array)->arrayElementSize();
 
-  return reinterpret_cast<uintptr_t*>(*array) + 2;
+    void* p = t->m->heap->allocate(size);
+    if (size) {
+      memcpy(p, body, size);
+    }
+
+    if (isCopy) {
+      *isCopy = true;
+    }
+
+    return p;
+  }
 }
 
-void JNICALL ReleasePrimitiveArrayCritical(Thread* t, jarray, void*, jint)
+void JNICALL
+    ReleasePrimitiveArrayCritical(Thread* t, jarray array, void* p, jint mode)
 {
-  if ((--t->criticalLevel) == 0) {
-    enter(t, Thread::IdleState);
+  ENTER(t, Thread::ActiveState);
+
+  void* body = reinterpret_cast<uintptr_t*>(*array) + 2;
+
+  if (p != body) {
+    unsigned size = fieldAtOffset<uintptr_t>(*array, BytesPerWord)
+                    * objectClass(t, *array)->arrayElementSize();
+
+    if (mode == 0 or mode == AVIAN_JNI_COMMIT) {
+      if (size) {
+        memcpy(body, p, size);
+      }
+    }
+
+    if (mode == 0 or mode == AVIAN_JNI_ABORT) {
+      t->m->heap->free(p, size);
+    }
   }
 }
 
@@ -3623,6 +3658,16 @@ extern "C" AVIAN_EXPORT jint JNICALL
   const char* bootClasspath = 0;
   const char* bootClasspathAppend = "";
   const char* crashDumpDirectory = 0;
+  unsigned pauseBudget = 0;
+  bool compaction = false;
+  bool pretenuring = false;
+  bool stackTraversal = false;
+  unsigned tenureThreshold = 0;
+  unsigned pauseGoal = 0;
+  unsigned overheadGoal = 0;
+  unsigned minimumFree = 0;
+  unsigned maximumFree = 0;
+  bool hugePages = false;
 
   unsigned propertyCount = 0;
 
@@ -3633,6 +3678,10 @@ extern "C" AVIAN_EXPORT jint JNICALL
         heapLimit = local::parseSize(p + 2);
       } else if (strncmp(p, "ss", 2) == 0) {
         stackLimit = local::parseSize(p + 2);
+      } else if (strncmp(p, "minf", 4) == 0) {
+        minimumFree = static_cast<unsigned>(atof(p + 4) * 100);
+      } else if (strncmp(p, "maxf", 4) == 0) {
+        maximumFree = static_cast<unsigned>(atof(p + 4) * 100);
       } else if (strncmp(p,
                          BOOTCLASSPATH_PREPEND_OPTION ":",
                          sizeof(BOOTCLASSPATH_PREPEND_OPTION)) == 0) {
@@ -3671,6 +3720,39 @@ extern "C" AVIAN_EXPORT jint JNICALL
       } else if (strncmp(p, REENTRANT_PROPERTY "=", sizeof(REENTRANT_PROPERTY))
                  == 0) {
         reentrant = strcmp(p + sizeof(REENTRANT_PROPERTY), "true") == 0;
+      } else if (strncmp(p,
+                         PAUSE_BUDGET_PROPERTY "=",
+                         sizeof(PAUSE_BUDGET_PROPERTY)) == 0) {
+        pauseBudget = atoi(p + sizeof(PAUSE_BUDGET_PROPERTY));
+      } else if (strncmp(p,
+                         COMPACTION_PROPERTY "=",
+                         sizeof(COMPACTION_PROPERTY)) == 0) {
+        compaction = strcmp(p + sizeof(COMPACTION_PROPERTY), "true") == 0;
+      } else if (strncmp(p,
+                         PRETENURING_PROPERTY "=",
+                         sizeof(PRETENURING_PROPERTY)) == 0) {
+        pretenuring = strcmp(p + sizeof(PRETENURING_PROPERTY), "true") == 0;
+      } else if (strncmp(p,
+                         STACK_TRAVERSAL_PROPERTY "=",
+                         sizeof(STACK_TRAVERSAL_PROPERTY)) == 0) {
+        stackTraversal
+            = strcmp(p + sizeof(STACK_TRAVERSAL_PROPERTY), "true") == 0;
+      } else if (strncmp(p,
+                         TENURE_THRESHOLD_PROPERTY "=",
+                         sizeof(TENURE_THRESHOLD_PROPERTY)) == 0) {
+        tenureThreshold = atoi(p + sizeof(TENURE_THRESHOLD_PROPERTY));
+      } else if (strncmp(p,
+                         PAUSE_GOAL_PROPERTY "=",
+                         sizeof(PAUSE_GOAL_PROPERTY)) == 0) {
+        pauseGoal = atoi(p + sizeof(PAUSE_GOAL_PROPERTY));
+      } else if (strncmp(p,
+                         OVERHEAD_GOAL_PROPERTY "=",
+                         sizeof(OVERHEAD_GOAL_PROPERTY)) == 0) {
+        overheadGoal = atoi(p + sizeof(OVERHEAD_GOAL_PROPERTY));
+      } else if (strncmp(p,
+                         HUGE_PAGES_PROPERTY "=",
+                         sizeof(HUGE_PAGES_PROPERTY)) == 0) {
+        hugePages = strcmp(p + sizeof(HUGE_PAGES_PROPERTY), "true") == 0;
       } else if (strncmp(p,
                          EMBED_PREFIX_PROPERTY "=",
                          sizeof(EMBED_PREFIX_PROPERTY)) == 0) {
@@ -3695,6 +3777,15 @@ extern "C" AVIAN_EXPORT jint JNICALL
 
   System* s = makeSystem(reentrant);
   Heap* h = makeHeap(s, heapLimit);
+  h->setHugePages(hugePages);
+  h->setPauseBudget(pauseBudget);
+  h->setCompaction(compaction);
+  h->setPretenuring(pretenuring);
+  h->setStackTraversal(stackTraversal);
+  h->setTenureThreshold(tenureThreshold);
+  h->setPauseGoal(pauseGoal);
+  h->setOverheadGoal(overheadGoal);
+  h->setFreeRatio(minimumFree, maximumFree);
   Classpath* c = makeClasspath(s, h, javaHome, embedPrefix);
 
   if (bootClasspath == 0) {
@@ -3730,7 +3821,7 @@ extern "C" AVIAN_EXPORT jint JNICALL
   Finder* af = makeFinder(s, h, classpath, bootLibrary);
   if (bootLibrary)
     free(bootLibrary);
-  Processor* p = makeProcessor(s, h, crashDumpDirectory, true);
+  Processor* p = makeProcessor(s, h, crashDumpDirectory, true, hugePages);
 
   // reserve space for avian.version and file.encoding:
   propertyCount += 2;
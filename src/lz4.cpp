@@ -0,0 +1,420 @@
+/* Copyright (c) 2008-2015, Avian Contributors
+
+   Permission to use, copy, modify, and/or distribute this software
+   for any purpose with or without fee is hereby granted, provided
+   that the above copyright notice and this permission notice appear
+   in all copies.
+
+   There is NO WARRANTY for this software.  See license.txt for
+   details. */
+
+#include <string.h>
+
+#include "avian/lz4.h"
+
+using namespace vm;
+
+namespace {
+
+const size_t HeaderSize = 8;
+const size_t MinMatch = 4;
+const size_t LastLiterals = 5;
+const size_t MatchFindLimit = 12;
+const size_t MaxOffset = 65535;
+const unsigned HashBits = 16;
+
+uint32_t read4(const uint8_t* in)
+{
+  return (static_cast<uint32_t>(in[3]) << 24)
+         | (static_cast<uint32_t>(in[2]) << 16)
+         | (static_cast<uint32_t>(in[1]) << 8) | (static_cast<uint32_t>(in[0]));
+}
+
+void writeLittleEndian4(uint8_t* out, uint32_t v)
+{
+  out[0] = v;
+  out[1] = v >> 8;
+  out[2] = v >> 16;
+  out[3] = v >> 24;
+}
+
+unsigned hash(uint32_t v)
+{
+  return (v * 2654435761U) >> (32 - HashBits);
+}
+
+size_t blockBound(size_t size)
+{
+  return size + (size / 255) + 16;
+}
+
+uint8_t* writeLength(uint8_t* out, size_t length)
+{
+  for (; length >= 255; length -= 255) {
+    *(out++) = 255;
+  }
+  *(out++) = length;
+  return out;
+}
+
+uint8_t* writeSequence(uint8_t* out,
+                       const uint8_t* literals,
+                       size_t literalLength,
+                       size_t offset,
+                       size_t matchLength)
+{
+  uint8_t* token = out++;
+
+  if (literalLength >= 15) {
+    *token = 15 << 4;
+    out = writeLength(out, literalLength - 15);
+  } else {
+    *token = literalLength << 4;
+  }
+
+  memcpy(out, literals, literalLength);
+  out += literalLength;
+
+  if (offset) {
+    *(out++) = offset;
+    *(out++) = offset >> 8;
+
+    matchLength -= MinMatch;
+    if (matchLength >= 15) {
+      *token |= 15;
+      out = writeLength(out, matchLength - 15);
+    } else {
+      *token |= matchLength;
+    }
+  }
+
+  return out;
+}
+
+size_t encodeBlock(const uint8_t* in,
+                   size_t size,
+                   uint8_t* out,
+                   uint32_t* table)
+{
+  memset(table, 0, sizeof(uint32_t) << HashBits);
+
+  uint8_t* p = out;
+  size_t anchor = 0;
+
+  if (size > MatchFindLimit) {
+    const size_t limit = size - MatchFindLimit;
+    const size_t matchLimit = size - LastLiterals;
+
+    for (size_t i = 0; i < limit;) {
+      uint32_t sequence = read4(in + i);
+      unsigned h = hash(sequence);
+      size_t candidate = table[h];
+      table[h] = i;
+
+      if (candidate < i and i - candidate <= MaxOffset
+          and read4(in + candidate) == sequence) {
+        while (i > anchor and candidate > 0
+               and in[i - 1] == in[candidate - 1]) {
+          --i;
+          --candidate;
+        }
+
+        size_t end = i + MinMatch;
+        while (end < matchLimit and in[end] == in[candidate + end - i]) {
+          ++end;
+        }
+
+        p = writeSequence(p, in + anchor, i - anchor, i - candidate, end - i);
+
+        i = anchor = end;
+      } else {
+        ++i;
+      }
+    }
+  }
+
+  p = writeSequence(p, in + anchor, size - anchor, 0, 0);
+
+  return p - out;
+}
+
+bool readLength(const uint8_t** in, const uint8_t* end, size_t* length)
+{
+  const uint8_t* p = *in;
+  uint8_t b;
+  do {
+    if (p == end) {
+      return false;
+    }
+    b = *(p++);
+    *length += b;
+  } while (b == 255);
+
+  *in = p;
+  return true;
+}
+
+bool decodeBlock(const uint8_t* in,
+                 size_t inSize,
+                 uint8_t* out,
+                 size_t outSize)
+{
+  const uint8_t* ip = in;
+  const uint8_t* inEnd = in + inSize;
+  uint8_t* op = out;
+  uint8_t* outEnd = out + outSize;
+
+  while (ip < inEnd) {
+    unsigned token = *(ip++);
+
+    size_t length = token >> 4;
+    if (length == 15 and not readLength(&ip, inEnd, &length)) {
+      return false;
+    }
+
+    if (length > static_cast<size_t>(inEnd - ip)
+        or length > static_cast<size_t>(outEnd - op)) {
+      return false;
+    }
+
+    memcpy(op, ip, length);
+    ip += length;
+    op += length;
+
+    if (ip == inEnd) {
+      // the last sequence has no match
+      break;
+    }
+
+    if (inEnd - ip < 2) {
+      return false;
+    }
+
+    size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+    ip += 2;
+
+    if (offset == 0 or offset > static_cast<size_t>(op - out)) {
+      return false;
+    }
+
+    length = token & 15;
+    if (length == 15 and not readLength(&ip, inEnd, &length)) {
+      return false;
+    }
+    length += MinMatch;
+
+    if (length > static_cast<size_t>(outEnd - op)) {
+      return false;
+    }
+
+    const uint8_t* match = op - offset;
+    if (offset >= length) {
+      memcpy(op, match, length);
+      op += length;
+    } else {
+      // overlapping copy, used to encode runs
+      for (uint8_t* end = op + length; op < end;) {
+        *(op++) = *(match++);
+      }
+    }
+  }
+
+  return op == outEnd;
+}
+
+class Frame {
+ public:
+  Frame(const uint8_t* in, size_t inSize)
+      : in(in),
+        inSize(inSize),
+        size(inSize >= HeaderSize ? read4(in) : 0),
+        blockSize(inSize >= HeaderSize ? read4(in + 4) : 0),
+        blockCount(blockSize ? (size + blockSize - 1) / blockSize : 0),
+        blocks(in + HeaderSize + (blockCount * 4))
+  {
+  }
+
+  bool valid()
+  {
+    if (inSize < HeaderSize or blockSize == 0
+        or (inSize - HeaderSize) / 4 < blockCount) {
+      return false;
+    }
+
+    size_t total = 0;
+    for (size_t i = 0; i < blockCount; ++i) {
+      total += read4(in + HeaderSize + (i * 4));
+    }
+
+    return total == inSize - (blocks - in);
+  }
+
+  const uint8_t* in;
+  size_t inSize;
+  size_t size;
+  size_t blockSize;
+  size_t blockCount;
+  const uint8_t* blocks;
+};
+
+class DecodeTask : public System::Runnable {
+ public:
+  DecodeTask(Frame* frame, uint8_t* out, unsigned start, unsigned stride)
+      : frame(frame),
+        out(out),
+        start(start),
+        stride(stride),
+        thread(0),
+        success(true)
+  {
+  }
+
+  virtual void attach(System::Thread* thread)
+  {
+    this->thread = thread;
+  }
+
+  virtual void run()
+  {
+    // block offsets are implied by the sizes of the blocks which
+    // precede them:
+    const uint8_t* block = frame->blocks;
+    for (unsigned i = 0; i < frame->blockCount; ++i) {
+      size_t blockInSize = read4(frame->in + HeaderSize + (i * 4));
+
+      if (i >= start and (i - start) % stride == 0) {
+        size_t blockOutSize = frame->size - (i * frame->blockSize);
+        if (blockOutSize > frame->blockSize) {
+          blockOutSize = frame->blockSize;
+        }
+
+        uint8_t* dst = out + (i * frame->blockSize);
+        if (blockInSize == blockOutSize) {
+          memcpy(dst, block, blockOutSize);
+        } else if (not decodeBlock(block, blockInSize, dst, blockOutSize)) {
+          success = false;
+          return;
+        }
+      }
+
+      block += blockInSize;
+    }
+  }
+
+  virtual bool interrupted()
+  {
+    return false;
+  }
+
+  virtual void setInterrupted(bool)
+  {
+  }
+
+  Frame* frame;
+  uint8_t* out;
+  unsigned start;
+  unsigned stride;
+  System::Thread* thread;
+  bool success;
+};
+
+}  // namespace
+
+namespace vm {
+
+uint8_t* decodeLZ4(System* s,
+                   avian::util::Alloc* a,
+                   const uint8_t* in,
+                   size_t inSize,
+                   size_t* outSize)
+{
+  Frame frame(in, inSize);
+  expect(s, frame.valid());
+
+  uint8_t* out = static_cast<uint8_t*>(a->allocate(frame.size));
+
+  unsigned threadCount = s->processorCount();
+  if (threadCount > frame.blockCount) {
+    threadCount = frame.blockCount;
+  }
+  if (threadCount == 0) {
+    threadCount = 1;
+  }
+
+  DecodeTask* tasks = static_cast<DecodeTask*>(
+      a->allocate(threadCount * sizeof(DecodeTask)));
+
+  for (unsigned i = 0; i < threadCount; ++i) {
+    new (tasks + i) DecodeTask(&frame, out, i, threadCount);
+
+    if (i) {
+      expect(s, s->success(s->start(tasks + i)));
+    }
+  }
+
+  tasks[0].run();
+
+  bool success = tasks[0].success;
+  for (unsigned i = 1; i < threadCount; ++i) {
+    tasks[i].thread->join();
+    tasks[i].thread->dispose();
+    success = success and tasks[i].success;
+  }
+
+  a->free(tasks, threadCount * sizeof(DecodeTask));
+
+  expect(s, success);
+
+  *outSize = frame.size;
+
+  return out;
+}
+
+uint8_t* encodeLZ4(avian::util::Alloc* a,
+                   const uint8_t* in,
+                   size_t inSize,
+                   size_t* outSize)
+{
+  size_t blockCount = (inSize + LZ4BlockSize - 1) / LZ4BlockSize;
+  size_t headerSize = HeaderSize + (blockCount * 4);
+  size_t bufferSize = headerSize + (blockCount * blockBound(LZ4BlockSize));
+
+  uint8_t* buffer = static_cast<uint8_t*>(a->allocate(bufferSize));
+  uint32_t* table
+      = static_cast<uint32_t*>(a->allocate(sizeof(uint32_t) << HashBits));
+
+  writeLittleEndian4(buffer, inSize);
+  writeLittleEndian4(buffer + 4, LZ4BlockSize);
+
+  uint8_t* p = buffer + headerSize;
+  for (size_t i = 0; i < blockCount; ++i) {
+    const uint8_t* block = in + (i * LZ4BlockSize);
+    size_t blockSize = inSize - (i * LZ4BlockSize);
+    if (blockSize > LZ4BlockSize) {
+      blockSize = LZ4BlockSize;
+    }
+
+    size_t size = encodeBlock(block, blockSize, p, table);
+    if (size >= blockSize) {
+      // incompressible, so store it as is:
+      memcpy(p, block, blockSize);
+      size = blockSize;
+    }
+
+    writeLittleEndian4(buffer + HeaderSize + (i * 4), size);
+    p += size;
+  }
+
+  a->free(table, sizeof(uint32_t) << HashBits);
+
+  *outSize = p - buffer;
+
+  uint8_t* out = static_cast<uint8_t*>(a->allocate(*outSize));
+  memcpy(out, buffer, *outSize);
+
+  a->free(buffer, bufferSize);
+
+  return out;
+}
+
+}  // namespace vm
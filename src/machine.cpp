@@ -16,6 +16,7 @@
 #include "avian/processor.h"
 #include "avian/arch.h"
 #include "avian/lzma.h"
+#include "avian/lz4.h"
 
 #include <avian/util/runtime-array.h>
 #include <avian/util/math.h>
@@ -175,6 +176,117 @@ void interruptDaemon(Thread* m, Thread* o)
   }
 }
 
+// clears the part of a retired eden which was allocated from, on a
+// long-lived thread of its own so neither the mutator nor the
+// collection pause pays for it.  Each collection hands it one chunk to
+// clear and waits for the previous one to be finished.
+class EdenZeroer : public System::Runnable {
+ public:
+  EdenZeroer(System* s)
+      : monitor(0), thread(0), start(0), sizeInWords(0), stopping(false)
+  {
+    expect(s, s->success(s->make(&monitor)));
+  }
+
+  virtual void attach(System::Thread* t)
+  {
+    thread = t;
+  }
+
+  virtual void run()
+  {
+    monitor->acquire(thread);
+
+    while (true) {
+      while (sizeInWords == 0 and not stopping) {
+        monitor->wait(thread, 0);
+      }
+
+      if (sizeInWords == 0) {
+        break;
+      }
+
+      monitor->release(thread);
+
+      memset(start, 0, sizeInWords * BytesPerWord);
+
+      monitor->acquire(thread);
+
+      sizeInWords = 0;
+      monitor->notifyAll(thread);
+    }
+
+    monitor->release(thread);
+  }
+
+  virtual bool interrupted()
+  {
+    return false;
+  }
+
+  virtual void setInterrupted(bool)
+  {
+  }
+
+  System::Monitor* monitor;
+  System::Thread* thread;
+  uintptr_t* start;
+  unsigned sizeInWords;
+  bool stopping;
+};
+
+// waits for the zeroing thread to finish the chunk it was last given
+void joinEdenZeroer(Machine* m, System::Thread* context)
+{
+  EdenZeroer* z = static_cast<EdenZeroer*>(m->edenZeroer);
+  if (z->thread) {
+    z->monitor->acquire(context);
+    while (z->sizeInWords) {
+      z->monitor->wait(context, 0);
+    }
+    z->monitor->release(context);
+  }
+}
+
+// hands the specified chunk to the zeroing thread.  A null context
+// means the thread hasn't been started yet, in which case it will pick
+// the chunk up when it is.  If it couldn't be started at all, we clear
+// the chunk ourselves.
+void startEdenZeroer(Machine* m,
+                     System::Thread* context,
+                     uintptr_t* start,
+                     unsigned sizeInWords)
+{
+  EdenZeroer* z = static_cast<EdenZeroer*>(m->edenZeroer);
+  if (context == 0) {
+    z->start = start;
+    z->sizeInWords = sizeInWords;
+  } else if (z->thread) {
+    z->monitor->acquire(context);
+    z->start = start;
+    z->sizeInWords = sizeInWords;
+    z->monitor->notifyAll(context);
+    z->monitor->release(context);
+  } else {
+    memset(start, 0, sizeInWords * BytesPerWord);
+  }
+}
+
+void stopEdenZeroer(Machine* m, System::Thread* context)
+{
+  EdenZeroer* z = static_cast<EdenZeroer*>(m->edenZeroer);
+  if (z->thread) {
+    z->monitor->acquire(context);
+    z->stopping = true;
+    z->monitor->notifyAll(context);
+    z->monitor->release(context);
+
+    z->thread->join();
+    z->thread->dispose();
+    z->thread = 0;
+  }
+}
+
 void turnOffTheLights(Thread* t)
 {
   expect(t, t->m->liveCount == 1);
@@ -239,6 +351,8 @@ void turnOffTheLights(Thread* t)
   Finder* bf = m->bootFinder;
   Finder* af = m->appFinder;
 
+  stopEdenZeroer(m, t->systemThread);
+
   c->dispose();
   h->disposeFixies();
   m->dispose();
@@ -274,8 +388,6 @@ void killZombies(Thread* t, Thread* o)
 
 unsigned footprint(Thread* t)
 {
-  expect(t, t->criticalLevel == 0);
-
   unsigned n = t->heapOffset + t->heapIndex + t->backupHeapIndex;
 
   for (Thread* c = t->child; c; c = c->peer) {
@@ -360,6 +472,73 @@ bool walk(Thread*,
   return true;
 }
 
+// a faster version of the above for classes whose masks fit in a
+// single word, which covers every VM type, arrays, and most Java
+// classes.  We visit the set bits of the mask directly instead of
+// testing each one, and don't consult the mask per element when
+// walking arrays of references.
+bool walk(Heap::Walker* w,
+          uint32_t mask,
+          unsigned fixedSizeInWords,
+          unsigned arrayElementSizeInWords,
+          unsigned arrayLength,
+          unsigned start)
+{
+  uint32_t fixedMask = fixedSizeInWords < 32
+                           ? mask & ((static_cast<uint32_t>(1)
+                                      << fixedSizeInWords) - 1)
+                           : mask;
+  if (start) {
+    fixedMask = start < 32
+                    ? fixedMask & ~((static_cast<uint32_t>(1) << start) - 1)
+                    : 0;
+  }
+
+  for (; fixedMask; fixedMask &= fixedMask - 1) {
+    if (not w->visit(lowestBit(fixedMask))) {
+      return false;
+    }
+  }
+
+  if (arrayElementSizeInWords == 0) {
+    return true;
+  }
+
+  uint32_t elementMask = (mask >> fixedSizeInWords)
+                         & ((static_cast<uint32_t>(1)
+                             << arrayElementSizeInWords) - 1);
+  if (elementMask == 0) {
+    return true;
+  }
+
+  unsigned end = fixedSizeInWords + (arrayLength * arrayElementSizeInWords);
+  if (arrayElementSizeInWords == 1) {
+    for (unsigned i = max(start, fixedSizeInWords); i < end; ++i) {
+      if (not w->visit(i)) {
+        return false;
+      }
+    }
+  } else {
+    for (unsigned i = fixedSizeInWords; i < end;
+         i += arrayElementSizeInWords) {
+      uint32_t m = elementMask;
+      if (start > i) {
+        m = start - i < 32 ? m & ~((static_cast<uint32_t>(1) << (start - i))
+                                   - 1)
+                           : 0;
+      }
+
+      for (; m; m &= m - 1) {
+        if (not w->visit(i + lowestBit(m))) {
+          return false;
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
 object findInInterfaces(
     Thread* t,
     GcClass* class_,
@@ -663,6 +842,93 @@ void postVisit(Thread* t, Heap::Visitor* v)
   }
 }
 
+// empties eden by swapping it for the spare, which was cleared in the
+// background since the previous collection, and starts clearing what
+// was used of the old one.  If the heap has changed the limit on what
+// may be allocated between collections, we resize both first, making
+// do with less if the heap can't spare that much.
+void resetEden(Machine* m, System::Thread* context)
+{
+  joinEdenZeroer(m, context);
+
+  unsigned limit = m->heap->incomingLimit() / BytesPerWord;
+  if (limit != m->edenLimit) {
+    if (m->eden) {
+      m->heap->free(m->eden, m->edenCapacity * BytesPerWord);
+      m->heap->free(m->spareEden, m->edenCapacity * BytesPerWord);
+      m->eden = m->spareEden = 0;
+    }
+
+    m->edenLimit = limit;
+    m->edenCapacity = 0;
+    m->edenPosition = 0;
+
+    for (unsigned capacity = limit;
+         capacity >= MinimumThreadHeapChunkInWords;
+         capacity /= 2) {
+      m->eden = static_cast<uintptr_t*>(
+          m->heap->tryAllocate(capacity * BytesPerWord));
+      m->spareEden = static_cast<uintptr_t*>(
+          m->heap->tryAllocate(capacity * BytesPerWord));
+
+      if (m->eden and m->spareEden) {
+        // both are fresh, so clear one now and all of the other later:
+        memset(m->eden, 0, capacity * BytesPerWord);
+        m->edenCapacity = capacity;
+        m->edenPosition = capacity;
+        break;
+      }
+
+      if (m->eden) {
+        m->heap->free(m->eden, capacity * BytesPerWord);
+      }
+      if (m->spareEden) {
+        m->heap->free(m->spareEden, capacity * BytesPerWord);
+      }
+      m->eden = m->spareEden = 0;
+    }
+  } else {
+    uintptr_t* retired = m->eden;
+    m->eden = m->spareEden;
+    m->spareEden = retired;
+  }
+
+  startEdenZeroer(m, context, m->spareEden, m->edenPosition);
+
+  m->edenPosition = 0;
+}
+
+// gives the specified thread a new chunk of eden big enough to hold an
+// object of the specified size, returning false if eden is full.  We
+// don't need a lock for this, since eden is only reset during a
+// collection, which waits for every thread to become idle.  Nor do we
+// need to clear the chunk, since resetEden hands out eden already
+// zeroed.
+bool refillHeap(Thread* t, unsigned sizeInWords)
+{
+  Machine* m = t->m;
+  unsigned size = max(t->heapChunkSize, sizeInWords);
+
+  uint32_t position;
+  do {
+    position = m->edenPosition;
+    if (position + size > m->edenCapacity) {
+      return false;
+    }
+  } while (not atomicCompareAndSwap32(
+      &(m->edenPosition), position, position + size));
+
+  uintptr_t* chunk = m->eden + position;
+
+  t->heapOffset += t->heapIndex;
+  t->heap = chunk;
+  t->heapIndex = 0;
+  t->heapCapacity = size;
+  t->heapChunkSize = min(t->heapChunkSize * 2, ThreadHeapSizeInWords);
+
+  return true;
+}
+
 void postCollect(Thread* t)
 {
 #ifdef VM_STRESS
@@ -680,6 +946,12 @@ void postCollect(Thread* t)
   }
 
   t->heapOffset = 0;
+  t->heapCapacity = ThreadHeapSizeInWords;
+
+  // threads which allocated little since the last collection should
+  // take smaller chunks next time:
+  t->heapChunkSize
+      = max(t->heapChunkSize / 2, MinimumThreadHeapChunkInWords);
 
   if (t->m->heap->limitExceeded()) {
     // if we're out of memory, pretend the thread-local heap is
@@ -3479,6 +3751,15 @@ class HeapClient : public Heap::Client {
     ::walk(m->rootThread, w, o, 0);
   }
 
+  virtual uintptr_t site(void* p)
+  {
+    // we don't record where each object was allocated, but objects of
+    // the same class tend to serve the same purpose:
+    object o = static_cast<object>(m->heap->follow(maskAlignedPointer(p)));
+    return reinterpret_cast<uintptr_t>(
+        m->heap->follow(objectClass(m->rootThread, o)));
+  }
+
   void dispose()
   {
     m->heap->free(this, sizeof(*this));
@@ -3504,27 +3785,23 @@ void doCollect(Thread* t, Heap::CollectionType type, int pendingAllocation)
   Machine* m = t->m;
 
   m->unsafe = true;
-  m->heap->collect(
-      type,
-      footprint(m->rootThread),
-      pendingAllocation - (t->m->heapPoolIndex * ThreadHeapSizeInWords));
+  m->heap->collect(type, footprint(m->rootThread), pendingAllocation);
   m->unsafe = false;
 
   postCollect(m->rootThread);
 
   killZombies(t, m->rootThread);
 
-  for (unsigned i = 0; i < m->heapPoolIndex; ++i) {
-    m->heap->free(m->heapPool[i], ThreadHeapSizeInBytes);
-  }
-  m->heapPoolIndex = 0;
+  resetEden(m, t->systemThread);
 
   if (m->heap->limitExceeded()) {
     // if we're out of memory, disallow further allocations of fixed
     // objects:
     m->fixedFootprint = FixedFootprintThresholdInBytes;
+    m->largeFootprint = LargeFootprintThresholdInBytes;
   } else {
     m->fixedFootprint = 0;
+    m->largeFootprint = 0;
   }
 
 #ifdef VM_STRESS
@@ -3695,6 +3972,7 @@ Machine::Machine(System* system,
       liveCount(0),
       daemonCount(0),
       fixedFootprint(0),
+      largeFootprint(0),
       stackSizeInBytes(stackSizeInBytes),
       localThread(0),
       stateLock(0),
@@ -3717,10 +3995,28 @@ Machine::Machine(System* system,
       triedBuiltinOnLoad(false),
       dumpedHeapOnOOM(false),
       alive(true),
-      heapPoolIndex(0)
+      eden(0),
+      spareEden(0),
+      edenZeroer(0),
+      edenLimit(0),
+      edenCapacity(0),
+      edenPosition(0)
 {
   heap->setClient(heapClient);
 
+  // the zeroing thread starts with whatever resetEden leaves for it,
+  // or, if it can't be started, we clear that now and every later
+  // chunk as we go:
+  EdenZeroer* z = new (heap->allocate(sizeof(EdenZeroer))) EdenZeroer(system);
+  edenZeroer = z;
+
+  resetEden(this, 0);
+
+  if (not system->success(system->start(z))) {
+    memset(z->start, 0, z->sizeInWords * BytesPerWord);
+    z->sizeInWords = 0;
+  }
+
   populateJNITables(&javaVMVTable, &jniEnvVTable);
 
   // Copying the properties memory (to avoid memory crashes)
@@ -3788,8 +4084,13 @@ void Machine::dispose()
     heap->free(tmp, sizeof(*tmp));
   }
 
-  for (unsigned i = 0; i < heapPoolIndex; ++i) {
-    heap->free(heapPool[i], ThreadHeapSizeInBytes);
+  EdenZeroer* z = static_cast<EdenZeroer*>(edenZeroer);
+  z->monitor->dispose();
+  heap->free(z, sizeof(EdenZeroer));
+
+  if (eden) {
+    heap->free(eden, edenCapacity * BytesPerWord);
+    heap->free(spareEden, edenCapacity * BytesPerWord);
   }
 
   if (bootimage) {
@@ -3816,13 +4117,14 @@ Thread::Thread(Machine* m, GcThread* javaThread, Thread* parent)
       child(0),
       waitNext(0),
       state(NoState),
-      criticalLevel(0),
       systemThread(0),
       lock(0),
       javaThread(javaThread),
       exception(0),
       heapIndex(0),
       heapOffset(0),
+      heapCapacity(ThreadHeapSizeInWords),
+      heapChunkSize(MinimumThreadHeapChunkInWords),
       protector(0),
       classInitStack(0),
       libraryLoadStack(0),
@@ -3856,7 +4158,10 @@ void Thread::init()
     const char* imageFunctionName = findProperty(m, "avian.bootimage");
     if (imageFunctionName) {
       bool lzma = strncmp("lzma:", imageFunctionName, 5) == 0;
-      const char* symbolName = lzma ? imageFunctionName + 5 : imageFunctionName;
+      bool lz4 = strncmp("lz4:", imageFunctionName, 4) == 0;
+      const char* symbolName
+          = lzma ? imageFunctionName + 5
+                 : (lz4 ? imageFunctionName + 4 : imageFunctionName);
 
       void* imagep = m->libraries->resolve(symbolName);
       if (imagep) {
@@ -3871,6 +4176,13 @@ void Thread::init()
               m->system, m->heap, imageBytes, size, &(m->bootimageSize)));
 #else
           abort(this);
+#endif
+        } else if (lz4) {
+#ifdef AVIAN_USE_LZ4
+          m->bootimage = image = reinterpret_cast<BootImage*>(decodeLZ4(
+              m->system, m->heap, imageBytes, size, &(m->bootimageSize)));
+#else
+          abort(this);
 #endif
         } else {
           image = reinterpret_cast<BootImage*>(imageBytes);
@@ -4227,7 +4539,7 @@ object allocate2(Thread* t, unsigned sizeInBytes, bool objectMask)
       t,
       t->m->heap,
       ceilingDivide(sizeInBytes, BytesPerWord) > ThreadHeapSizeInWords
-          ? Machine::FixedAllocation
+          ? Machine::LargeAllocation
           : Machine::MovableAllocation,
       sizeInBytes,
       objectMask);
@@ -4239,8 +4551,6 @@ object allocate3(Thread* t,
                  unsigned sizeInBytes,
                  bool objectMask)
 {
-  expect(t, t->criticalLevel == 0);
-
   if (UNLIKELY(t->getFlags() & Thread::UseBackupHeapFlag)) {
     expect(t,
            t->backupHeapIndex + ceilingDivide(sizeInBytes, BytesPerWord)
@@ -4253,7 +4563,13 @@ object allocate3(Thread* t,
   } else if (UNLIKELY(t->getFlags() & Thread::TracingFlag)) {
     expect(t,
            t->heapIndex + ceilingDivide(sizeInBytes, BytesPerWord)
-           <= ThreadHeapSizeInWords);
+           <= t->heapCapacity);
+    return allocateSmall(t, sizeInBytes);
+  } else if (type == Machine::MovableAllocation and not t->m->exclusive
+             and t->heapIndex + ceilingDivide(sizeInBytes, BytesPerWord)
+                 > t->heapCapacity
+             and not t->m->heap->limitExceeded()
+             and refillHeap(t, ceilingDivide(sizeInBytes, BytesPerWord))) {
     return allocateSmall(t, sizeInBytes);
   }
 
@@ -4273,20 +4589,10 @@ object allocate3(Thread* t,
     switch (type) {
     case Machine::MovableAllocation:
       if (t->heapIndex + ceilingDivide(sizeInBytes, BytesPerWord)
-          > ThreadHeapSizeInWords) {
+          > t->heapCapacity) {
         t->heap = 0;
-        if ((not t->m->heap->limitExceeded())
-            and t->m->heapPoolIndex < ThreadHeapPoolSize) {
-          t->heap = static_cast<uintptr_t*>(
-              t->m->heap->tryAllocate(ThreadHeapSizeInBytes));
-
-          if (t->heap) {
-            memset(t->heap, 0, ThreadHeapSizeInBytes);
-
-            t->m->heapPool[t->m->heapPoolIndex++] = t->heap;
-            t->heapOffset += t->heapIndex;
-            t->heapIndex = 0;
-          }
+        if (not t->m->heap->limitExceeded()) {
+          refillHeap(t, ceilingDivide(sizeInBytes, BytesPerWord));
         }
       }
       break;
@@ -4299,6 +4605,14 @@ object allocate3(Thread* t,
 
     case Machine::ImmortalAllocation:
       break;
+
+    case Machine::LargeAllocation:
+      if (t->m->largeFootprint + sizeInBytes
+          > max(LargeFootprintThresholdInBytes,
+                t->m->heap->largeFootprint())) {
+        t->heap = 0;
+      }
+      break;
     }
 
     int pendingAllocation = t->m->heap->fixedFootprint(
@@ -4315,7 +4629,7 @@ object allocate3(Thread* t,
     }
   } while (type == Machine::MovableAllocation
            and t->heapIndex + ceilingDivide(sizeInBytes, BytesPerWord)
-               > ThreadHeapSizeInWords);
+               > t->heapCapacity);
 
   switch (type) {
   case Machine::MovableAllocation: {
@@ -4347,6 +4661,17 @@ object allocate3(Thread* t,
     return o;
   }
 
+  case Machine::LargeAllocation: {
+    object o = static_cast<object>(t->m->heap->allocateLarge(
+        ceilingDivide(sizeInBytes, BytesPerWord), objectMask));
+
+    alias(o, 0) = FixedMark;
+
+    t->m->largeFootprint += sizeInBytes;
+
+    return o;
+  }
+
   default:
     abort(t);
   }
@@ -4356,16 +4681,13 @@ void collect(Thread* t, Heap::CollectionType type, int pendingAllocation)
 {
   ENTER(t, Thread::ExclusiveState);
 
-  unsigned pending = pendingAllocation
-                     - (t->m->heapPoolIndex * ThreadHeapSizeInWords);
-
-  if (t->m->heap->limitExceeded(pending)) {
+  if (t->m->heap->limitExceeded(pendingAllocation)) {
     type = Heap::MajorCollection;
   }
 
   doCollect(t, type, pendingAllocation);
 
-  if (t->m->heap->limitExceeded(pending)) {
+  if (t->m->heap->limitExceeded(pendingAllocation)) {
     // try once more, giving the heap a chance to squeeze everything
     // into the smallest possible space:
     doCollect(t, Heap::MajorCollection, pendingAllocation);
@@ -5544,18 +5866,29 @@ void walk(Thread* t, Heap::Walker* w, object o, unsigned start)
                                                    o, fixedSize - BytesPerWord)
                                              : 0);
 
-    THREAD_RUNTIME_ARRAY(t, uint32_t, mask, objectMask->length());
-    memcpy(RUNTIME_ARRAY_BODY(mask),
-           objectMask->body().begin(),
-           objectMask->length() * 4);
-
-    more = ::walk(t,
-                  w,
-                  RUNTIME_ARRAY_BODY(mask),
-                  fixedSize,
-                  arrayElementSize,
-                  arrayLength,
-                  start);
+    if (objectMask->length() == 1) {
+      // read the mask before visiting anything, since the collector
+      // may overwrite the original when it copies the mask itself:
+      more = ::walk(w,
+                    objectMask->body()[0],
+                    ceilingDivide(fixedSize, BytesPerWord),
+                    ceilingDivide(arrayElementSize, BytesPerWord),
+                    arrayLength,
+                    start);
+    } else {
+      THREAD_RUNTIME_ARRAY(t, uint32_t, mask, objectMask->length());
+      memcpy(RUNTIME_ARRAY_BODY(mask),
+             objectMask->body().begin(),
+             objectMask->length() * 4);
+
+      more = ::walk(t,
+                    w,
+                    RUNTIME_ARRAY_BODY(mask),
+                    fixedSize,
+                    arrayElementSize,
+                    arrayLength,
+                    start);
+    }
   } else if (class_->vmFlags() & SingletonFlag) {
     GcSingleton* s = cast<GcSingleton>(t, o);
     unsigned length = s->length();
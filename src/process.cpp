@@ -218,16 +218,67 @@ void* resolveNativeMethod(Thread* t,
   return 0;
 }
 
+// Returns true if the specified method may be implemented by a
+// critical native, i.e. it is static, unsynchronized, and takes and
+// returns only primitives and primitive arrays (arguments only).  Such
+// a native is called without a JNIEnv, class argument, or state
+// transition, and each array argument is passed as its length followed
+// by a pointer to its elements.
+bool criticalCandidate(Thread* t UNUSED, GcMethod* method, int* footprint)
+{
+  if ((method->flags() & ACC_STATIC) == 0
+      or (method->flags() & ACC_SYNCHRONIZED)) {
+    return false;
+  }
+
+  const int8_t* p = method->spec()->body().begin() + 1;
+  *footprint = 0;
+  while (*p != ')') {
+    switch (*(p++)) {
+    case '[':
+      if (*p == '[' or *p == 'L') {
+        return false;
+      }
+      ++p;
+      *footprint += 2;
+      break;
+
+    case 'L':
+      return false;
+
+    case 'J':
+    case 'D':
+      *footprint += 2;
+      break;
+
+    default:
+      ++(*footprint);
+      break;
+    }
+  }
+
+  ++p;
+  return *p != '[' and *p != 'L';
+}
+
 GcNative* resolveNativeMethod(Thread* t, GcMethod* method)
 {
   void* p = resolveNativeMethod(t, method, "Avian_", 6, 3);
   if (p) {
-    return makeNative(t, p, true);
+    return makeNative(t, p, true, false, 0);
+  }
+
+  int footprint;
+  if (criticalCandidate(t, method, &footprint)) {
+    p = resolveNativeMethod(t, method, "JavaCritical_", 13, footprint);
+    if (p) {
+      return makeNative(t, p, false, true, 0);
+    }
   }
 
   p = resolveNativeMethod(t, method, "Java_", 5, -1);
   if (p) {
-    return makeNative(t, p, false);
+    return makeNative(t, p, false, false, 0);
   }
 
   return 0;
@@ -268,6 +319,38 @@ void resolveNative(Thread* t, GcMethod* method)
   }
 }
 
+// Fills in the dynamicCall argument types for the specified resolved
+// native method: the JNIEnv and class or receiver pointers followed by
+// the declared parameters.  These are computed from the method spec
+// on the first call and cached in the method's native thereafter.
+void getNativeTypes(Thread* t, GcMethod* method, uint8_t* types)
+{
+  unsigned count = method->parameterCount() + 2;
+
+  GcNative* native = getMethodRuntimeData(t, method)->native();
+  GcByteArray* array = native->types();
+  if (array == 0) {
+    PROTECT(t, method);
+    PROTECT(t, native);
+
+    array = makeByteArray(t, count);
+
+    unsigned i = 0;
+    array->body()[i++] = POINTER_TYPE;
+    array->body()[i++] = POINTER_TYPE;
+
+    MethodSpecIterator it(
+        t, reinterpret_cast<const char*>(method->spec()->body().begin()));
+    while (it.hasNext()) {
+      array->body()[i++] = fieldType(t, fieldCode(t, *it.next()));
+    }
+
+    native->setTypes(t, array);
+  }
+
+  memcpy(types, array->body().begin(), count);
+}
+
 int findLineNumber(Thread* t UNUSED, GcMethod* method, unsigned ip)
 {
   if (method->flags() & ACC_NATIVE) {
@@ -683,9 +683,12 @@ class MySystem : public System {
   {
     Thread* t = new (allocate(this, sizeof(Thread))) Thread(this, r);
     r->attach(t);
-    int rv UNUSED = pthread_create(&(t->thread), 0, run, r);
-    expect(this, rv == 0);
-    return 0;
+    int rv = pthread_create(&(t->thread), 0, run, r);
+    if (rv != 0) {
+      r->attach(0);
+      t->dispose();
+    }
+    return rv;
   }
 
   virtual Status make(System::Mutex** m)
@@ -925,6 +928,12 @@ class MySystem : public System {
            + (static_cast<int64_t>(tv.tv_usec) / 1000);
   }
 
+  virtual unsigned processorCount()
+  {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? count : 1;
+  }
+
   virtual void yield()
   {
     sched_yield();
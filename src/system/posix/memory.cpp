@@ -18,9 +18,11 @@ namespace avian {
 namespace system {
 
 const size_t Memory::PageSize = 1 << 12;
+const size_t Memory::HugePageSize = 1 << 21;
 
 util::Slice<uint8_t> Memory::allocate(size_t sizeInBytes,
-                               Permissions perms)
+                                      Permissions perms,
+                                      bool hugePages)
 {
   unsigned prot = 0;
   if(perms & Read) {
@@ -33,13 +35,61 @@ util::Slice<uint8_t> Memory::allocate(size_t sizeInBytes,
     prot |= PROT_EXEC;
   }
 #ifdef MAP_32BIT
-  // map to the lower 32 bits of memory when possible so as to avoid
-  // expensive relative jumps
-  const unsigned Extra = MAP_32BIT;
+  // map code to the lower 32 bits of memory when possible so as to
+  // avoid expensive relative jumps
+  const unsigned Extra = (perms & Execute) ? MAP_32BIT : 0;
 #else
   const unsigned Extra = 0;
 #endif
 
+  if (hugePages) {
+    sizeInBytes = (sizeInBytes + HugePageSize - 1) & ~(HugePageSize - 1);
+
+    void* p;
+
+#ifdef MAP_HUGETLB
+    p = mmap(0,
+             sizeInBytes,
+             prot,
+             MAP_PRIVATE | MAP_ANON | MAP_HUGETLB | Extra,
+             -1,
+             0);
+
+    if (p != MAP_FAILED) {
+      return util::Slice<uint8_t>(static_cast<uint8_t*>(p), sizeInBytes);
+    }
+#endif
+
+    // no huge pages have been reserved, so map a range aligned to a
+    // huge page boundary and ask for transparent huge pages instead:
+    p = mmap(0,
+             sizeInBytes + HugePageSize,
+             prot,
+             MAP_PRIVATE | MAP_ANON | Extra,
+             -1,
+             0);
+
+    if (p == MAP_FAILED) {
+      return util::Slice<uint8_t>(0, 0);
+    }
+
+    uint8_t* start = static_cast<uint8_t*>(p);
+    uint8_t* aligned = reinterpret_cast<uint8_t*>(
+        (reinterpret_cast<uintptr_t>(start) + HugePageSize - 1)
+        & ~(HugePageSize - 1));
+
+    if (aligned > start) {
+      munmap(start, aligned - start);
+    }
+    munmap(aligned + sizeInBytes, start + HugePageSize - aligned);
+
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, sizeInBytes, MADV_HUGEPAGE);
+#endif
+
+    return util::Slice<uint8_t>(aligned, sizeInBytes);
+  }
+
   void* p = mmap(0,
                  sizeInBytes,
                  prot,
@@ -59,5 +109,10 @@ void Memory::free(util::Slice<uint8_t> pages)
   munmap(const_cast<uint8_t*>(pages.begin()), pages.count);
 }
 
+void Memory::release(util::Slice<uint8_t> pages)
+{
+  madvise(pages.begin(), pages.count, MADV_DONTNEED);
+}
+
 }  // namespace system
 }  // namespace avian
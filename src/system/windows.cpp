@@ -702,7 +702,11 @@ class MySystem : public System {
     r->attach(t);
     DWORD id;
     t->thread = CreateThread(0, 0, run, r, 0, &id);
-    assertT(this, t->thread);
+    if (t->thread == 0) {
+      r->attach(0);
+      t->dispose();
+      return 1;
+    }
     return 0;
   }
 
@@ -988,6 +992,17 @@ class MySystem : public System {
              | time.dwLowDateTime) / 10000) - 11644473600000LL;
   }
 
+  virtual unsigned processorCount()
+  {
+    SYSTEM_INFO info;
+#if !defined(WINAPI_FAMILY) || WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)
+    GetSystemInfo(&info);
+#else
+    GetNativeSystemInfo(&info);
+#endif
+    return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+  }
+
   virtual void yield()
   {
 #if !defined(WINAPI_FAMILY) || WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)
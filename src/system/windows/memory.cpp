@@ -18,9 +18,11 @@ namespace avian {
 namespace system {
 
 const size_t Memory::PageSize = 1 << 12;
+const size_t Memory::HugePageSize = 1 << 21;
 
 util::Slice<uint8_t> Memory::allocate(size_t sizeInBytes,
-                               Permissions perms)
+                                      Permissions perms,
+                                      bool hugePages)
 {
   unsigned prot;
   switch(perms) {
@@ -39,6 +41,18 @@ util::Slice<uint8_t> Memory::allocate(size_t sizeInBytes,
   default:
     UNREACHABLE_;
   }
+  if (hugePages) {
+    sizeInBytes = (sizeInBytes + HugePageSize - 1) & ~(HugePageSize - 1);
+
+    // this only works if the process holds SeLockMemoryPrivilege, so
+    // fall back to normal pages if it fails:
+    void* ret = VirtualAlloc(
+        0, sizeInBytes, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, prot);
+    if (ret) {
+      return util::Slice<uint8_t>((uint8_t*)ret, sizeInBytes);
+    }
+  }
+
   void* ret = VirtualAlloc(
       0, sizeInBytes, MEM_COMMIT | MEM_RESERVE, prot);
   return util::Slice<uint8_t>((uint8_t*)ret, sizeInBytes);
@@ -51,5 +65,10 @@ void Memory::free(util::Slice<uint8_t> pages)
   ASSERT(r);
 }
 
+void Memory::release(util::Slice<uint8_t> pages)
+{
+  VirtualAlloc(pages.begin(), pages.count, MEM_RESET, PAGE_READWRITE);
+}
+
 }  // namespace system
 }  // namespace avian
@@ -24,6 +24,7 @@
 #include <fcntl.h>
 
 #include <avian/tools/object-writer/tools.h>
+#include <avian/lz4.h>
 
 extern "C" void __cxa_pure_virtual()
 {
@@ -68,12 +69,30 @@ bool writeObject(uint8_t* data,
                                alignment);
 }
 
+class MyAllocator : public Alloc {
+ public:
+  virtual void* allocate(size_t size)
+  {
+    void* p = malloc(size);
+    if (p == 0) {
+      fprintf(stderr, "unable to allocate %zu bytes\n", size);
+      exit(-1);
+    }
+    return p;
+  }
+
+  virtual void free(const void* p, size_t)
+  {
+    ::free(const_cast<void*>(p));
+  }
+};
+
 void usageAndExit(const char* name)
 {
   fprintf(stderr,
           "usage: %s <input file> <output file> <start name> <end name> "
           "<platform> <architecture> "
-          "[<alignment> [{writable|executable}...]]\n",
+          "[<alignment> [{writable|executable|lz4}...]]\n",
           name);
   exit(-1);
 }
@@ -82,7 +101,7 @@ void usageAndExit(const char* name)
 
 int main(int argc, const char** argv)
 {
-  if (argc < 7 || argc > 10) {
+  if (argc < 7 || argc > 11) {
     usageAndExit(argv[0]);
   }
 
@@ -93,12 +112,15 @@ int main(int argc, const char** argv)
 
   bool writable = false;
   bool executable = false;
+  bool lz4 = false;
 
   for (int i = 8; i < argc; ++i) {
     if (strcmp("writable", argv[i]) == 0) {
       writable = true;
     } else if (strcmp("executable", argv[i]) == 0) {
       executable = true;
+    } else if (strcmp("lz4", argv[i]) == 0) {
+      lz4 = true;
     } else {
       usageAndExit(argv[0]);
     }
@@ -145,10 +167,17 @@ int main(int argc, const char** argv)
   bool success = false;
 
   if (data) {
+    MyAllocator allocator;
+    uint8_t* content = data;
+    size_t contentSize = size;
+    if (lz4) {
+      content = vm::encodeLZ4(&allocator, data, size, &contentSize);
+    }
+
     FileOutputStream out(argv[2]);
     if (out.isValid()) {
-      success = writeObject(data,
-                            size,
+      success = writeObject(content,
+                            contentSize,
                             &out,
                             argv[3],
                             argv[4],
@@ -160,6 +189,10 @@ int main(int argc, const char** argv)
       fprintf(stderr, "unable to open %s\n", argv[2]);
     }
 
+    if (lz4) {
+      allocator.free(content, contentSize);
+    }
+
 #ifdef _WIN32
     UnmapViewOfFile(data);
 #else
@@ -20,6 +20,7 @@
 #include <avian/tools/object-writer/tools.h>
 #include <avian/util/runtime-array.h>
 #include "avian/lzma.h"
+#include "avian/lz4.h"
 
 #include <avian/util/arg-parser.h>
 #include <avian/util/abort.h>
@@ -643,15 +644,125 @@ void addClass(Thread* t,
   }
 }
 
+const unsigned CompileBatchSize = 256;
+
+// Methods are queued up and compiled in fixed-size batches so that
+// the back end of the compiler may run on several threads (see
+// Processor::compileMethods).  Since the batches don't depend on the
+// number of threads, neither does the resulting image.
+class CompileQueue {
+ public:
+  CompileQueue(Thread* t,
+               Zone** zones,
+               unsigned threadCount,
+               GcTriple** constants,
+               GcTriple** calls,
+               GcPair** methods,
+               DelayedPromise** addresses,
+               OffsetResolver* resolver,
+               JavaVM* hostVM,
+               GcHashMap* compiled)
+      : t(t),
+        zones(zones),
+        threadCount(threadCount),
+        constants(constants),
+        calls(calls),
+        methods(methods),
+        addresses(addresses),
+        resolver(resolver),
+        hostVM(hostVM),
+        compiled(compiled),
+        queue(0),
+        count(0),
+        compiledProtector(t, &(this->compiled)),
+        queueProtector(t, &queue)
+  {
+  }
+
+  void add(GcMethod* method)
+  {
+    PROTECT(t, method);
+
+    if (compiled) {
+      // methods named in a profile are compiled ahead of the rest, so
+      // make sure we don't visit them (and relocate them) twice:
+      if (hashMapFind(t,
+                      compiled,
+                      reinterpret_cast<object>(method),
+                      objectHash,
+                      objectEqual)) {
+        return;
+      }
+
+      hashMapInsert(t,
+                    compiled,
+                    reinterpret_cast<object>(method),
+                    reinterpret_cast<object>(method),
+                    objectHash);
+    }
+
+    queue = makePair(
+        t, reinterpret_cast<object>(method), reinterpret_cast<object>(queue));
+
+    if (++count == CompileBatchSize) {
+      flush();
+    }
+  }
+
+  void flush()
+  {
+    if (count == 0) {
+      return;
+    }
+
+    GcArray* batch = makeArray(t, count);
+    PROTECT(t, batch);
+
+    for (GcPair* p = queue; p; p = cast<GcPair>(t, p->second())) {
+      batch->setBodyElement(t, --count, p->first());
+    }
+
+    queue = 0;
+
+    t->m->processor->compileMethods(t,
+                                    zones,
+                                    threadCount,
+                                    constants,
+                                    calls,
+                                    addresses,
+                                    batch,
+                                    resolver,
+                                    hostVM);
+
+    for (unsigned i = 0; i < batch->length(); ++i) {
+      GcMethod* method = cast<GcMethod>(t, batch->body()[i]);
+      if (method->code()) {
+        *methods = makePair(t,
+                            reinterpret_cast<object>(method),
+                            reinterpret_cast<object>(*methods));
+      }
+    }
+  }
+
+  Thread* t;
+  Zone** zones;
+  unsigned threadCount;
+  GcTriple** constants;
+  GcTriple** calls;
+  GcPair** methods;
+  DelayedPromise** addresses;
+  OffsetResolver* resolver;
+  JavaVM* hostVM;
+  GcHashMap* compiled;
+  GcPair* queue;
+  unsigned count;
+  Thread::SingleProtector compiledProtector;
+  Thread::SingleProtector queueProtector;
+};
+
 void compileMethods(Thread* t,
                     GcClass* c,
-                    Zone* zone,
-                    GcTriple** constants,
-                    GcTriple** calls,
-                    GcPair** methods,
-                    DelayedPromise** addresses,
-                    OffsetResolver* resolver,
-                    JavaVM* hostVM,
+                    CompileQueue* queue,
                     const char* methodName,
                     const char* methodSpec)
 {
@@ -671,14 +782,7 @@ void compileMethods(Thread* t,
         if (method->code() or (method->flags() & ACC_NATIVE)) {
           PROTECT(t, method);
 
-          t->m->processor->compileMethod(
-              t, zone, constants, calls, addresses, method, resolver, hostVM);
-
-          if (method->code()) {
-            *methods = makePair(t,
-                                reinterpret_cast<object>(method),
-                                reinterpret_cast<object>(*methods));
-          }
+          queue->add(method);
         }
 
         GcMethodAddendum* addendum = method->addendum();
@@ -709,14 +813,552 @@ void compileMethods(Thread* t,
   }
 }
 
+// Notes on tree shaking:
+//
+// When a root class is specified via -tree-shake, we only load,
+// compile, and image the classes which are transitively reachable
+// from that class, from the avian package, from the types the VM
+// itself defines in types.def, and from any class matching a pattern
+// in the keep file (see vm.keep).  Reachability is computed
+// conservatively at class granularity by scanning each class file's
+// constant pool for class references, type descriptors, and string
+// constants naming classes on the class path (the latter catches the
+// common Class.forName idiom).  Classes which are only referred to by
+// name from native code or by strings built at runtime must be listed
+// in the keep file.
+//
+// We don't remove individual methods or fields from reachable
+// classes, since the VM relies on their layout matching the class
+// files it may load at runtime.
+
+class KeepList {
+ public:
+  KeepList(System* s, const char* path) : region(0), patternCount(0)
+  {
+    if (path) {
+      if (not s->success(s->map(&region, path))) {
+        fprintf(stderr, "unable to open %s\n", path);
+        abort(s);
+      }
+
+      text = static_cast<char*>(malloc(region->length() + 1));
+      memcpy(text, region->start(), region->length());
+      text[region->length()] = 0;
+
+      // count patterns first so we can allocate the table in one go:
+      patterns = static_cast<const char**>(
+          malloc(sizeof(const char*) * (countLines() + 1)));
+
+      for (char* p = text; *p;) {
+        char* line = p;
+        while (*p and *p != '\n' and *p != '\r') {
+          ++p;
+        }
+        if (*p) {
+          *(p++) = 0;
+        }
+
+        char* comment = strchr(line, '#');
+        if (comment) {
+          *comment = 0;
+        }
+
+        while (*line == ' ' or *line == '\t') {
+          ++line;
+        }
+
+        char* end = line + strlen(line);
+        while (end > line and (end[-1] == ' ' or end[-1] == '\t')) {
+          *(--end) = 0;
+        }
+
+        if (*line) {
+          patterns[patternCount++] = line;
+        }
+      }
+    } else {
+      text = 0;
+      patterns = 0;
+    }
+  }
+
+  ~KeepList()
+  {
+    if (region) {
+      region->dispose();
+      free(text);
+      free(patterns);
+    }
+  }
+
+  unsigned countLines()
+  {
+    unsigned count = 1;
+    for (char* p = text; *p; ++p) {
+      if (*p == '\n') {
+        ++count;
+      }
+    }
+    return count;
+  }
+
+  // '*' matches any sequence of characters except '/', '**' matches
+  // any sequence at all, and '.' is treated as a package separator so
+  // that patterns may be written in either source or internal form:
+  static bool matches(const char* pattern, const char* s, const char* end)
+  {
+    while (*pattern) {
+      if (*pattern == '*') {
+        bool any = pattern[1] == '*';
+        pattern += any ? 2 : 1;
+        for (const char* p = s;; ++p) {
+          if (matches(pattern, p, end)) {
+            return true;
+          } else if (p == end or ((not any) and *p == '/')) {
+            return false;
+          }
+        }
+      } else if (s == end or (*pattern == '.' ? '/' : *pattern) != *s) {
+        return false;
+      }
+
+      ++pattern;
+      ++s;
+    }
+
+    return s == end;
+  }
+
+  bool matches(const char* name, unsigned length)
+  {
+    for (unsigned i = 0; i < patternCount; ++i) {
+      if (matches(patterns[i], name, name + length)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  System::Region* region;
+  char* text;
+  const char** patterns;
+  unsigned patternCount;
+};
+
+bool isReachable(Thread* t,
+                 GcHashMap* reachable,
+                 const char* name,
+                 unsigned length)
+{
+  return hashMapFind(t,
+                     reachable,
+                     reinterpret_cast<object>(
+                         makeByteArray(t, "%.*s", length, name)),
+                     byteArrayHash,
+                     byteArrayEqual) != 0;
+}
+
+void markReachable(Thread* t,
+                   Finder* finder,
+                   GcHashMap* reachable,
+                   GcPair** queue,
+                   const char* name,
+                   unsigned length)
+{
+  PROTECT(t, reachable);
+
+  if (length and name[0] == '[') {
+    // an array type; we only care about its element type
+    while (length and name[0] == '[') {
+      ++name;
+      --length;
+    }
+
+    if (length > 2 and name[0] == 'L' and name[length - 1] == ';') {
+      ++name;
+      length -= 2;
+    } else {
+      return;
+    }
+  }
+
+  GcByteArray* key = makeByteArray(t, "%.*s", length, name);
+  PROTECT(t, key);
+
+  if (hashMapFind(t,
+                  reachable,
+                  reinterpret_cast<object>(key),
+                  byteArrayHash,
+                  byteArrayEqual) == 0) {
+    THREAD_RUNTIME_ARRAY(t, char, file, length + 7);
+    memcpy(RUNTIME_ARRAY_BODY(file), name, length);
+    memcpy(RUNTIME_ARRAY_BODY(file) + length, ".class", 7);
+
+    size_t fileLength;
+    if (finder->stat(RUNTIME_ARRAY_BODY(file), &fileLength)
+        == System::TypeFile) {
+      hashMapInsert(t,
+                    reachable,
+                    reinterpret_cast<object>(key),
+                    reinterpret_cast<object>(key),
+                    byteArrayHash);
+
+      *queue = makePair(
+          t, reinterpret_cast<object>(key), reinterpret_cast<object>(*queue));
+    }
+  }
+}
+
+// mark any class named by a descriptor embedded in the specified
+// string, e.g. "(Ljava/lang/String;I)V":
+void markDescriptors(Thread* t,
+                     Finder* finder,
+                     GcHashMap* reachable,
+                     GcPair** queue,
+                     const char* s,
+                     unsigned length)
+{
+  const char* end = s + length;
+  for (const char* p = s; p < end; ++p) {
+    if (*p == 'L') {
+      const char* semicolon
+          = static_cast<const char*>(memchr(p, ';', end - p));
+      if (semicolon == 0) {
+        return;
+      }
+
+      if (semicolon - p > 1) {
+        markReachable(t, finder, reachable, queue, p + 1, semicolon - p - 1);
+      }
+
+      p = semicolon;
+    }
+  }
+}
+
+void scanClass(Thread* t,
+               Finder* finder,
+               GcHashMap* reachable,
+               GcPair** queue,
+               const uint8_t* start,
+               size_t length)
+{
+  class Client : public Stream::Client {
+   public:
+    Client(Thread* t) : t(t)
+    {
+    }
+
+    virtual void NO_RETURN handleError()
+    {
+      abort(t);
+    }
+
+   private:
+    Thread* t;
+  } client(t);
+
+  Stream s(&client, start, length);
+
+  uint32_t magic = s.read4();
+  expect(t, magic == 0xCAFEBABE);
+  s.read2();  // minor version
+  s.read2();  // major version
+
+  unsigned count = s.read2();
+
+  // offsets of the CONSTANT_Utf8 entries (zero for other entries) and
+  // the indexes of the entries which refer to them by tag:
+  THREAD_RUNTIME_ARRAY(t, unsigned, utf8Offsets, count);
+  THREAD_RUNTIME_ARRAY(t, uint8_t, referers, count);
+  memset(RUNTIME_ARRAY_BODY(utf8Offsets), 0, count * sizeof(unsigned));
+  memset(RUNTIME_ARRAY_BODY(referers), 0, count);
+
+  for (unsigned i = 1; i < count; ++i) {
+    unsigned tag = s.read1();
+    switch (tag) {
+    case CONSTANT_Utf8:
+      RUNTIME_ARRAY_BODY(utf8Offsets)[i] = s.position();
+      s.skip(s.read2());
+      break;
+
+    case CONSTANT_Class:
+    case CONSTANT_String: {
+      unsigned index = s.read2();
+      expect(t, index < count);
+      RUNTIME_ARRAY_BODY(referers)[index] = tag;
+    } break;
+
+    case CONSTANT_MethodType:
+      s.skip(2);
+      break;
+
+    case CONSTANT_Integer:
+    case CONSTANT_Float:
+    case CONSTANT_NameAndType:
+    case CONSTANT_Fieldref:
+    case CONSTANT_Methodref:
+    case CONSTANT_InterfaceMethodref:
+    case CONSTANT_InvokeDynamic:
+      s.skip(4);
+      break;
+
+    case CONSTANT_MethodHandle:
+      s.skip(3);
+      break;
+
+    case CONSTANT_Long:
+    case CONSTANT_Double:
+      s.skip(8);
+      ++i;
+      break;
+
+    default:
+      fprintf(stderr, "unknown class constant: %d\n", tag);
+      abort(t);
+    }
+  }
+
+  for (unsigned i = 1; i < count; ++i) {
+    unsigned offset = RUNTIME_ARRAY_BODY(utf8Offsets)[i];
+    if (offset) {
+      const char* string = reinterpret_cast<const char*>(start + offset + 2);
+      unsigned stringLength = (start[offset] << 8) | start[offset + 1];
+
+      switch (RUNTIME_ARRAY_BODY(referers)[i]) {
+      case CONSTANT_Class:
+        markReachable(t, finder, reachable, queue, string, stringLength);
+        break;
+
+      case CONSTANT_String: {
+        // possibly a class name passed to Class.forName or the like
+        THREAD_RUNTIME_ARRAY(t, char, name, stringLength + 1);
+        for (unsigned j = 0; j < stringLength; ++j) {
+          RUNTIME_ARRAY_BODY(name)[j] = string[j] == '.' ? '/' : string[j];
+        }
+        markReachable(t,
+                      finder,
+                      reachable,
+                      queue,
+                      RUNTIME_ARRAY_BODY(name),
+                      stringLength);
+      } break;
+
+      default:
+        markDescriptors(t, finder, reachable, queue, string, stringLength);
+        break;
+      }
+    }
+  }
+}
+
+GcHashMap* findReachableClasses(Thread* t,
+                                Finder* finder,
+                                const char* rootClass,
+                                const char* keepFile)
+{
+  GcHashMap* reachable = makeHashMap(t, 0, 0);
+  PROTECT(t, reachable);
+
+  GcPair* queue = 0;
+  PROTECT(t, queue);
+
+  KeepList keep(t->m->system, keepFile);
+
+  markReachable(t, finder, reachable, &queue, rootClass, strlen(rootClass));
+
+  for (HashMapIterator it(t, cast<GcHashMap>(t, roots(t)->bootLoader()->map()));
+       it.hasMore();) {
+    GcByteArray* name = cast<GcByteArray>(t, it.next()->first());
+    markReachable(t,
+                  finder,
+                  reachable,
+                  &queue,
+                  reinterpret_cast<const char*>(name->body().begin()),
+                  name->length() - 1);
+  }
+
+  unsigned total = 0;
+  for (Finder::Iterator it(finder); it.hasMore();) {
+    size_t nameSize = 0;
+    const char* name = it.next(&nameSize);
+
+    if (endsWith(".class", name, nameSize)) {
+      ++total;
+
+      if (strncmp(name, "avian/", 6) == 0
+          or keep.matches(name, nameSize - 6)) {
+        markReachable(t, finder, reachable, &queue, name, nameSize - 6);
+      }
+    }
+  }
+
+  while (queue) {
+    GcByteArray* name = cast<GcByteArray>(t, queue->first());
+    queue = cast<GcPair>(t, queue->second());
+
+    THREAD_RUNTIME_ARRAY(t, char, file, name->length() + 6);
+    memcpy(RUNTIME_ARRAY_BODY(file), name->body().begin(), name->length() - 1);
+    memcpy(RUNTIME_ARRAY_BODY(file) + name->length() - 1, ".class", 7);
+
+    System::Region* region = finder->find(RUNTIME_ARRAY_BODY(file));
+    if (region) {
+      THREAD_RESOURCE(t, System::Region*, region, region->dispose());
+
+      scanClass(
+          t, finder, reachable, &queue, region->start(), region->length());
+    }
+  }
+
+  fprintf(stderr,
+          "tree shaking kept %d of %d classes\n",
+          reachable->size(),
+          total);
+
+  return reachable;
+}
+
+// Notes on method ordering:
+//
+// By default, methods are laid out in the code image in class and
+// method table order, which scatters the code needed at startup
+// across the whole image.  Given a profile written by a JIT build
+// run with -Davian.jit.profile=<file> (or a log written with
+// -Davian.jit.log=<file>), we compile the profiled methods first, in
+// the order in which they were first executed, so that they end up
+// contiguous at the start of the image.  Everything else follows in
+// the usual order.  Methods named in the profile which aren't part
+// of the image are ignored.
+
+GcMethod* findMethod(Thread* t,
+                     GcClass* c,
+                     const char* name,
+                     unsigned nameLength,
+                     const char* spec,
+                     unsigned specLength)
+{
+  if (GcArray* mtable = cast<GcArray>(t, c->methodTable())) {
+    for (unsigned i = 0; i < mtable->length(); ++i) {
+      GcMethod* method = cast<GcMethod>(t, mtable->body()[i]);
+      if (method->name()->length() == nameLength + 1
+          and method->spec()->length() == specLength + 1
+          and memcmp(method->name()->body().begin(), name, nameLength) == 0
+          and memcmp(method->spec()->body().begin(), spec, specLength) == 0) {
+        return method;
+      }
+    }
+  }
+  return 0;
+}
+
+void compileProfiledMethods(Thread* t,
+                            const char* profileFile,
+                            GcPair* classes,
+                            CompileQueue* queue)
+{
+  PROTECT(t, classes);
+
+  System* s = t->m->system;
+  System::Region* region;
+  if (not s->success(s->map(&region, profileFile))) {
+    fprintf(stderr, "unable to open %s\n", profileFile);
+    abort(s);
+  }
+
+  THREAD_RESOURCE(t, System::Region*, region, region->dispose());
+
+  // index the classes we're imaging by name so we can ignore
+  // profiled methods belonging to anything else:
+  GcHashMap* index = makeHashMap(t, 0, 0);
+  PROTECT(t, index);
+
+  for (GcPair* p = classes; p; p = cast<GcPair>(t, p->second())) {
+    GcClass* c = cast<GcClass>(t, p->first());
+    hashMapInsert(t,
+                  index,
+                  reinterpret_cast<object>(c->name()),
+                  reinterpret_cast<object>(c),
+                  byteArrayHash);
+  }
+
+  const char* text = reinterpret_cast<const char*>(region->start());
+  const char* end = text + region->length();
+  unsigned total = 0;
+  unsigned placed = 0;
+
+  while (text < end) {
+    const char* line = text;
+    while (text < end and *text != '\n' and *text != '\r') {
+      ++text;
+    }
+    const char* lineEnd = text;
+    if (text < end) {
+      ++text;
+    }
+
+    // accept both "class.name(spec)" lines and avian.jit.log lines,
+    // which prefix the same thing with the code bounds:
+    const char* entry = lineEnd;
+    while (entry > line and entry[-1] != ' ' and entry[-1] != '\t') {
+      --entry;
+    }
+
+    const char* spec = static_cast<const char*>(
+        memchr(entry, '(', lineEnd - entry));
+    if (spec == 0) {
+      continue;
+    }
+
+    const char* name = spec;
+    while (name > entry and name[-1] != '.') {
+      --name;
+    }
+    if (name == entry) {
+      continue;
+    }
+
+    ++total;
+
+    GcClass* c = cast<GcClass>(
+        t,
+        hashMapFind(t,
+                    index,
+                    reinterpret_cast<object>(
+                        makeByteArray(t, "%.*s", name - 1 - entry, entry)),
+                    byteArrayHash,
+                    byteArrayEqual));
+    if (c == 0) {
+      continue;
+    }
+
+    GcMethod* method
+        = findMethod(t, c, name, spec - name, spec, lineEnd - spec);
+    if (method and method->code()) {
+      queue->add(method);
+      ++placed;
+    }
+  }
+
+  queue->flush();
+
+  fprintf(stderr,
+          "method ordering placed %d of %d profiled methods\n",
+          placed,
+          total);
+}
+
 GcTriple* makeCodeImage(Thread* t,
-                        Zone* zone,
+                        Zone** zones,
+                        unsigned threadCount,
                         BootImage* image,
                         uint8_t* code,
                         JavaVM* hostVM,
                         const char* className,
                         const char* methodName,
                         const char* methodSpec,
+                        const char* shakeRoot,
+                        const char* keepFile,
+                        const char* profileFile,
                         GcHashMap* typeMaps)
 {
   PROTECT(t, typeMaps);
@@ -758,12 +1400,21 @@ GcTriple* makeCodeImage(Thread* t,
   Finder* finder = static_cast<Finder*>(
       roots(t)->bootLoader()->as<GcSystemClassLoader>(t)->finder());
 
+  GcHashMap* reachable = 0;
+  PROTECT(t, reachable);
+
+  if (shakeRoot) {
+    reachable = findReachableClasses(t, finder, shakeRoot, keepFile);
+  }
+
   for (Finder::Iterator it(finder); it.hasMore();) {
     size_t nameSize = 0;
     const char* name = it.next(&nameSize);
 
     if (endsWith(".class", name, nameSize)
-        and (className == 0 or strncmp(name, className, nameSize - 6) == 0)) {
+        and (className == 0 or strncmp(name, className, nameSize - 6) == 0)
+        and (reachable == 0
+             or isReachable(t, reachable, name, nameSize - 6))) {
       if (false) {
         fprintf(stderr, "pass 1 %.*s\n", (int)nameSize - 6, name);
       }
@@ -798,7 +1449,9 @@ GcTriple* makeCodeImage(Thread* t,
     const char* name = it.next(&nameSize);
 
     if (endsWith(".class", name, nameSize)
-        and (className == 0 or strncmp(name, className, nameSize - 6) == 0)) {
+        and (className == 0 or strncmp(name, className, nameSize - 6) == 0)
+        and (reachable == 0
+             or isReachable(t, reachable, name, nameSize - 6))) {
       if (false) {
         fprintf(stderr, "pass 2 %.*s\n", (int)nameSize - 6, name);
       }
@@ -814,6 +1467,21 @@ GcTriple* makeCodeImage(Thread* t,
     }
   }
 
+  CompileQueue queue(t,
+                     zones,
+                     threadCount,
+                     &constants,
+                     &calls,
+                     &methods,
+                     &addresses,
+                     &resolver,
+                     hostVM,
+                     profileFile ? makeHashMap(t, 0, 0) : 0);
+
+  if (profileFile) {
+    compileProfiledMethods(t, profileFile, classes, &queue);
+  }
+
   // Each method compilation may result in the creation of new,
   // synthetic classes (e.g. for lambda expressions), so we must
   // iterate until we've visited them all:
@@ -826,16 +1494,12 @@ GcTriple* makeCodeImage(Thread* t,
     for (; myClasses; myClasses = cast<GcPair>(t, myClasses->second())) {
       compileMethods(t,
                      cast<GcClass>(t, myClasses->first()),
-                     zone,
-                     &constants,
-                     &calls,
-                     &methods,
-                     &addresses,
-                     &resolver,
-                     hostVM,
+                     &queue,
                      methodName,
                      methodSpec);
     }
+
+    queue.flush();
   }
 
   for (; calls; calls = cast<GcTriple>(t, calls->third())) {
@@ -1499,7 +2163,12 @@ void writeBootImage2(Thread* t,
                      const char* bootimageEnd,
                      const char* codeimageStart,
                      const char* codeimageEnd,
-                     bool useLZMA)
+                     bool useLZMA,
+                     bool useLZ4,
+                     const char* shakeRoot,
+                     const char* keepFile,
+                     const char* profileFile,
+                     unsigned threadCount)
 {
   GcThrowable* throwable
       = cast<GcThrowable>(t, make(t, type(t, GcOutOfMemoryError::Type)));
@@ -1508,6 +2177,24 @@ void writeBootImage2(Thread* t,
 
   Zone zone(t->m->heap, 64 * 1024);
 
+  // the compiler needs a zone per thread, since it updates promises
+  // allocated there while assembling code:
+  Zone** zones
+      = static_cast<Zone**>(zone.allocate(threadCount * sizeof(Zone*)));
+  zones[0] = &zone;
+  for (unsigned i = 1; i < threadCount; ++i) {
+    zones[i] = new (zone.allocate(sizeof(Zone))) Zone(t->m->heap, 64 * 1024);
+  }
+
+  THREAD_RESOURCE2(t,
+                   Zone**,
+                   zones,
+                   unsigned,
+                   threadCount,
+                   for (unsigned i = 1; i < threadCount; ++i) {
+                     zones[i]->dispose();
+                   });
+
   class MyCompilationHandler : public Processor::CompilationHandler {
    public:
     String heapDup(const char* name)
@@ -1713,13 +2400,17 @@ void writeBootImage2(Thread* t,
     }
 
     constants = makeCodeImage(t,
-                              &zone,
+                              zones,
+                              threadCount,
                               image,
                               code,
                               hostVM,
                               className,
                               methodName,
                               methodSpec,
+                              shakeRoot,
+                              keepFile,
+                              profileFile,
                               typeMaps);
 
     PROTECT(t, constants);
@@ -1947,6 +2638,17 @@ void writeBootImage2(Thread* t,
 #else
       abort(t);
 #endif
+    } else if (useLZ4) {
+#ifdef AVIAN_USE_LZ4
+      bootimage = encodeLZ4(t->m->heap,
+                            bootimageData.data,
+                            bootimageData.length,
+                            &bootimageLength);
+
+      fprintf(stderr, "compressed heap size %zu\n", bootimageLength);
+#else
+      abort(t);
+#endif
     } else {
       bootimage = bootimageData.data;
       bootimageLength = bootimageData.length;
@@ -1962,7 +2664,7 @@ void writeBootImage2(Thread* t,
                           Platform::Writable,
                           TargetBytesPerWord);
 
-    if (useLZMA) {
+    if (useLZMA or useLZ4) {
       t->m->heap->free(bootimage, bootimageLength);
     }
 
@@ -2000,6 +2702,11 @@ uint64_t writeBootImage(Thread* t, uintptr_t* arguments)
   const char* codeimageStart = reinterpret_cast<const char*>(arguments[10]);
   const char* codeimageEnd = reinterpret_cast<const char*>(arguments[11]);
   bool useLZMA = arguments[12];
+  const char* shakeRoot = reinterpret_cast<const char*>(arguments[13]);
+  const char* keepFile = reinterpret_cast<const char*>(arguments[14]);
+  const char* profileFile = reinterpret_cast<const char*>(arguments[15]);
+  unsigned threadCount = arguments[16];
+  bool useLZ4 = arguments[17];
 
   writeBootImage2(t,
                   bootimageOutput,
@@ -2014,7 +2721,12 @@ uint64_t writeBootImage(Thread* t, uintptr_t* arguments)
                   bootimageEnd,
                   codeimageStart,
                   codeimageEnd,
-                  useLZMA);
+                  useLZMA,
+                  useLZ4,
+                  shakeRoot,
+                  keepFile,
+                  profileFile,
+                  threadCount);
 
   return 1;
 }
@@ -2047,6 +2759,14 @@ class Arguments {
   char* codeimageEnd;
 
   bool useLZMA;
+  bool useLZ4;
+
+  char* shakeRoot;
+  const char* keepFile;
+
+  const char* profileFile;
+
+  unsigned threadCount;
 
   bool maybeSplit(const char* src, char*& destA, char*& destB)
   {
@@ -2069,7 +2789,8 @@ class Arguments {
         bootimageStart(0),
         bootimageEnd(0),
         codeimageStart(0),
-        codeimageEnd(0)
+        codeimageEnd(0),
+        shakeRoot(0)
   {
     ArgParser parser;
     Arg classpath(parser, true, "cp", "<classpath>");
@@ -2087,6 +2808,11 @@ class Arguments {
                          "codeimage-symbols",
                          "<start symbol name>:<end symbol name>");
     Arg useLZMA(parser, false, "use-lzma", 0);
+    Arg useLZ4(parser, false, "use-lz4", 0);
+    Arg treeShake(parser, false, "tree-shake", "<root class name>");
+    Arg keep(parser, false, "keep", "<keep file>");
+    Arg methodOrder(parser, false, "method-order", "<profile file>");
+    Arg threads(parser, false, "threads", "<compiler thread count>");
 
     if (!parser.parse(ac, av)) {
       parser.printUsage(av[0]);
@@ -2098,6 +2824,40 @@ class Arguments {
     this->codeimage = codeimage.value;
     this->hostvm = hostvm.value;
     this->useLZMA = useLZMA.value != 0;
+    this->useLZ4 = useLZ4.value != 0;
+
+    if (this->useLZMA and this->useLZ4) {
+      fprintf(stderr, "-use-lzma and -use-lz4 are mutually exclusive\n");
+      parser.printUsage(av[0]);
+      exit(1);
+    }
+    this->keepFile = keep.value;
+    this->profileFile = methodOrder.value;
+
+    if (threads.value) {
+      int count = atoi(threads.value);
+      if (count < 1) {
+        fprintf(stderr, "invalid thread count: %s\n", threads.value);
+        parser.printUsage(av[0]);
+        exit(1);
+      }
+      threadCount = count;
+    } else {
+      threadCount = 1;
+    }
+
+    if (treeShake.value) {
+      shakeRoot = strdup(treeShake.value);
+      for (char* p = shakeRoot; *p; ++p) {
+        if (*p == '.') {
+          *p = '/';
+        }
+      }
+    } else if (keep.value) {
+      fprintf(stderr, "-keep is only meaningful with -tree-shake\n");
+      parser.printUsage(av[0]);
+      exit(1);
+    }
 
     if (entry.value) {
       if (const char* entryClassEnd = strchr(entry.value, '.')) {
@@ -2161,6 +2921,9 @@ class Arguments {
     if (codeimageEnd) {
       free(codeimageEnd);
     }
+    if (shakeRoot) {
+      free(shakeRoot);
+    }
   }
 
   void dump()
@@ -2176,7 +2939,11 @@ class Arguments {
         "bootimageStart = %s\n"
         "bootimageEnd = %s\n"
         "codeimageStart = %s\n"
-        "codeimageEnd = %s\n",
+        "codeimageEnd = %s\n"
+        "shakeRoot = %s\n"
+        "keepFile = %s\n"
+        "profileFile = %s\n"
+        "threadCount = %u\n",
         classpath,
         bootimage,
         codeimage,
@@ -2187,7 +2954,11 @@ class Arguments {
         bootimageStart,
         bootimageEnd,
         codeimageStart,
-        codeimageEnd);
+        codeimageEnd,
+        shakeRoot,
+        keepFile,
+        profileFile,
+        threadCount);
   }
 };
 
@@ -2202,7 +2973,7 @@ int main(int ac, const char** av)
   Heap* h = makeHeap(s, HeapCapacity * 2);
   Classpath* c = makeClasspath(s, h, AVIAN_JAVA_HOME, AVIAN_EMBED_PREFIX);
   Finder* f = makeFinder(s, h, args.classpath, 0);
-  Processor* p = makeProcessor(s, h, 0, false);
+  Processor* p = makeProcessor(s, h, 0, false, false);
 
 // todo: currently, the compiler cannot compile code with jumps or
 // calls spanning more than the maximum size of an immediate value
@@ -2306,7 +3077,12 @@ int main(int ac, const char** av)
                            reinterpret_cast<uintptr_t>(args.bootimageEnd),
                            reinterpret_cast<uintptr_t>(args.codeimageStart),
                            reinterpret_cast<uintptr_t>(args.codeimageEnd),
-                           static_cast<uintptr_t>(args.useLZMA)};
+                           static_cast<uintptr_t>(args.useLZMA),
+                           reinterpret_cast<uintptr_t>(args.shakeRoot),
+                           reinterpret_cast<uintptr_t>(args.keepFile),
+                           reinterpret_cast<uintptr_t>(args.profileFile),
+                           static_cast<uintptr_t>(args.threadCount),
+                           static_cast<uintptr_t>(args.useLZ4)};
 
   run(t, writeBootImage, arguments);
 
@@ -24,6 +24,67 @@ public class Datagrams {
   public static void main(String[] args) throws Exception {
     test(true);
     test(false);
+    testBatch();
+  }
+
+  private static void testBatch() throws Exception {
+    final String Hostname = "localhost";
+    final SocketAddress InAddress = new InetSocketAddress(Hostname, 22045);
+    final SocketAddress OutAddress = new InetSocketAddress(Hostname, 22046);
+    final byte[][] Messages = { "one".getBytes(), "two".getBytes(),
+                                "three".getBytes() };
+
+    DatagramChannel out = DatagramChannel.open();
+    try {
+      out.socket().bind(OutAddress);
+
+      DatagramChannel in = DatagramChannel.open();
+      try {
+        in.socket().bind(InAddress);
+
+        ByteBuffer[] srcs = new ByteBuffer[Messages.length];
+        SocketAddress[] targets = new SocketAddress[Messages.length];
+        for (int i = 0; i < Messages.length; ++i) {
+          // mix heap and direct buffers
+          srcs[i] = (i % 2 == 0) ? ByteBuffer.wrap(Messages[i])
+            : ByteBuffer.allocateDirect(Messages[i].length);
+          if (! srcs[i].hasArray()) {
+            srcs[i].put(Messages[i]);
+            srcs[i].flip();
+          }
+          targets[i] = InAddress;
+        }
+
+        int sent = 0;
+        while (sent < Messages.length) {
+          sent += out.send(srcs, targets, sent, Messages.length - sent);
+        }
+
+        ByteBuffer[] dsts = new ByteBuffer[Messages.length];
+        for (int i = 0; i < Messages.length; ++i) {
+          dsts[i] = ByteBuffer.allocate(64);
+        }
+        SocketAddress[] sources = new SocketAddress[Messages.length];
+
+        int received = 0;
+        while (received < Messages.length) {
+          received += in.receive
+            (dsts, sources, received, Messages.length - received);
+        }
+
+        for (int i = 0; i < Messages.length; ++i) {
+          expect(! srcs[i].hasRemaining());
+          expect(dsts[i].position() == Messages[i].length);
+          expect(equal(dsts[i].array(), dsts[i].arrayOffset(), Messages[i], 0,
+                       Messages[i].length));
+          expect(sources[i].equals(OutAddress));
+        }
+      } finally {
+        in.close();
+      }
+    } finally {
+      out.close();
+    }
   }
 
   private static void test(boolean send) throws Exception {
@@ -66,11 +127,15 @@ public class Datagrams {
                 } else {
                   out.write(ByteBuffer.wrap(Message));
                 }
+                // the selector should stop reporting this key from now on
+                outKey.interestOps(0);
                 state = 1;
               }
             } break;
 
             case 1: {
+              expect(! outKey.isWritable());
+
               if (inKey.isReadable()) {
                 expect(in.receive(inBuffer).equals(OutAddress));
                 if (! inBuffer.hasRemaining()) {
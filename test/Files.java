@@ -1,6 +1,10 @@
 import java.io.File;
 import java.io.FileInputStream;
 import java.io.FileOutputStream;
+import java.io.RandomAccessFile;
+import java.nio.ByteBuffer;
+import java.nio.MappedByteBuffer;
+import java.nio.channels.FileChannel;
 
 public class Files {
   private static final boolean IsWindows
@@ -44,6 +48,43 @@ public class Files {
     }
   }
   
+  private static void channelTest() throws Exception {
+    byte[] message = "hello, world!\n".getBytes();
+
+    File a = File.createTempFile("avian.", null);
+    File b = File.createTempFile("avian.", null);
+    try {
+      RandomAccessFile in = new RandomAccessFile(a, "rw");
+      RandomAccessFile out = new RandomAccessFile(b, "rw");
+      try {
+        MappedByteBuffer map = in.getChannel().map
+          (FileChannel.MapMode.READ_WRITE, 0, message.length);
+        map.put(message);
+        map.force();
+
+        expect(in.length() == message.length);
+
+        FileChannel inChannel = in.getChannel();
+        FileChannel outChannel = out.getChannel();
+        expect(inChannel.transferTo(7, 100, outChannel)
+               == message.length - 7);
+        expect(outChannel.transferFrom(inChannel, message.length - 7, 5)
+               == 5);
+
+        map = outChannel.map(FileChannel.MapMode.READ_ONLY, 0, out.length());
+        byte[] result = new byte[map.remaining()];
+        map.get(result);
+        expect(new String(result).equals("world!\nhello"));
+      } finally {
+        in.close();
+        out.close();
+      }
+    } finally {
+      a.delete();
+      b.delete();
+    }
+  }
+
   public static void main(String[] args) throws Exception {
     isAbsoluteTest(true);
     isAbsoluteTest(false);
@@ -95,6 +136,10 @@ public class Files {
     expect(new File("foo/bar//").getParent().equals("foo"));
 
     expect(new File("foo/nonexistent-directory").listFiles() == null);
+
+    if (! IsWindows) {
+      channelTest();
+    }
   }
 
 }
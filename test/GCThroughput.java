@@ -0,0 +1,122 @@
+/**
+ * Measures how long collections take with wide, deep, and bushy object
+ * graphs live.  Run with -Davian.gc.stackTraversal=true to compare the
+ * explicit-stack traversal with the default pointer-reversal one.
+ */
+public class GCThroughput {
+
+    private static final int COLLECTIONS = 8;
+
+    private static class Node {
+        Node next;
+        Node[] children;
+        int value;
+
+        Node(int value) {
+            this.value = value;
+        }
+    }
+
+    private static void expect(boolean v) {
+        if (! v) throw new RuntimeException();
+    }
+
+    /**
+     * Builds an array of arrays of leaves, so most objects hang off a
+     * few very wide parents.
+     */
+    private static Object[] wide() {
+        Object[] top = new Object[256];
+        for (int i = 0; i < top.length; i++) {
+            Node[] row = new Node[256];
+            for (int j = 0; j < row.length; j++) {
+                row[j] = new Node(i * row.length + j);
+            }
+            top[i] = row;
+        }
+        return top;
+    }
+
+    private static void checkWide(Object[] top) {
+        for (int i = 0; i < top.length; i++) {
+            Node[] row = (Node[]) top[i];
+            for (int j = 0; j < row.length; j++) {
+                expect(row[j].value == i * row.length + j);
+            }
+        }
+    }
+
+    /**
+     * Builds a linked list, the deepest graph there is.
+     */
+    private static Node deep() {
+        Node head = null;
+        for (int i = 0; i < 64 * 1024; i++) {
+            Node n = new Node(i);
+            n.next = head;
+            head = n;
+        }
+        return head;
+    }
+
+    private static void checkDeep(Node head) {
+        int i = 64 * 1024;
+        for (Node n = head; n != null; n = n.next) {
+            expect(n.value == --i);
+        }
+        expect(i == 0);
+    }
+
+    /**
+     * Builds a complete tree with four children per node.
+     */
+    private static Node tree(int depth) {
+        Node n = new Node(depth);
+        if (depth > 0) {
+            n.children = new Node[4];
+            for (int i = 0; i < n.children.length; i++) {
+                n.children[i] = tree(depth - 1);
+            }
+        }
+        return n;
+    }
+
+    private static int count(Node n) {
+        int count = 1;
+        if (n.children != null) {
+            for (int i = 0; i < n.children.length; i++) {
+                expect(n.children[i].value == n.value - 1);
+                count += count(n.children[i]);
+            }
+        }
+        return count;
+    }
+
+    /**
+     * Collects COLLECTIONS times.
+     * @return average time per collection in milliseconds
+     */
+    private static double collect() {
+        long start = System.currentTimeMillis();
+        for (int i = 0; i < COLLECTIONS; i++) {
+            System.gc();
+        }
+        return 1.0 * (System.currentTimeMillis() - start) / COLLECTIONS;
+    }
+
+    public static void main(String[] args) {
+        Object[] wide = wide();
+        System.out.println("wide: " + collect() + "ms per collection");
+        checkWide(wide);
+        wide = null;
+
+        Node deep = deep();
+        System.out.println("deep: " + collect() + "ms per collection");
+        checkDeep(deep);
+        deep = null;
+
+        Node tree = tree(8);
+        System.out.println("tree: " + collect() + "ms per collection");
+        expect(count(tree) == (((1 << 18) - 1) / 3));
+    }
+}
@@ -76,6 +76,8 @@ public class JNI {
 
   private static native Object testLocalRef(Object o);
 
+  private static native long checksum(byte[] a, long seed, int[] b);
+
   public static int method242() { return 242; }
   
   public static final int field950 = 950;
@@ -137,5 +139,12 @@ public class JNI {
     { Object o = new Object();
       expect(testLocalRef(o) == o);
     }
+
+    // these only pass if the VM calls JavaCritical_JNI_checksum, which
+    // receives each array as a length and a pointer:
+    expect(checksum(new byte[] { 1, 2, 3 }, 1000000000000L,
+                    new int[] { 10, 20 }) == 1000000000036L);
+    expect(checksum(null, 7L, new int[] { 10 }) == 17L);
+    expect(checksum(new byte[] { -1 }, 0L, null) == -1L);
   }
 }
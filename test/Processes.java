@@ -27,5 +27,24 @@ public class Processes {
     } catch(IOException e) {
       throw new RuntimeException(e);
     }
+
+    // many short-lived children at once, each of which must be reaped
+    // with the right exit code
+    try {
+      Process[] processes = new Process[32];
+      for (int i = 0; i < processes.length; ++i) {
+        processes[i] = Runtime.getRuntime().exec(i % 2 == 0 ? "true" : "false");
+      }
+      for (int i = 0; i < processes.length; ++i) {
+        int code = processes[i].waitFor();
+        if ((code == 0) != (i % 2 == 0)) {
+          throw new RuntimeException("unexpected exit code " + code);
+        }
+      }
+    } catch(IOException e) {
+      throw new RuntimeException(e);
+    } catch(InterruptedException e) {
+      throw new RuntimeException(e);
+    }
   }
 }
@@ -98,6 +98,8 @@ else
     run make ${flags} mode=debug bootimage=true ${make_target}
     run make ${flags} bootimage=true ${make_target}
     run make ${flags} bootimage=true bootimage-test=true ${make_target}
+    run make ${flags} bootimage=true bootimage-test=true tree-shake=true \
+      ${make_target}
   fi
 
   if ! has_flag openjdk && ! has_flag android && ! has_flag arch; then
@@ -211,6 +211,31 @@ extern "C" JNIEXPORT jobject JNICALL
   return e->NewLocalRef(o);
 }
 
+// The VM should prefer JavaCritical_JNI_checksum below, so this returns
+// a value no checksum in JNI.java adds up to, and the test fails if it
+// is ever called instead.
+extern "C" JNIEXPORT jlong JNICALL
+    Java_JNI_checksum(JNIEnv*, jclass, jbyteArray, jlong, jintArray)
+{
+  return -42;
+}
+
+extern "C" JNIEXPORT jlong JNICALL JavaCritical_JNI_checksum(jint aLength,
+                                                             jbyte* a,
+                                                             jlong seed,
+                                                             jint bLength,
+                                                             jint* b)
+{
+  jlong sum = seed;
+  for (jint i = 0; i < aLength; ++i) {
+    sum += a[i];
+  }
+  for (jint i = 0; i < bLength; ++i) {
+    sum += b[i];
+  }
+  return sum;
+}
+
 extern "C" JNIEXPORT jobject JNICALL
     Java_Buffers_allocateNative(JNIEnv* e, jclass, jint capacity)
 {
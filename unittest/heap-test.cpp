@@ -0,0 +1,438 @@
+/* Copyright (c) 2008-2015, Avian Contributors
+
+   Permission to use, copy, modify, and/or distribute this software
+   for any purpose with or without fee is hereby granted, provided
+   that the above copyright notice and this permission notice appear
+   in all copies.
+
+   There is NO WARRANTY for this software.  See license.txt for
+   details. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "avian/common.h"
+#include <avian/heap/heap.h>
+#include <avian/system/system.h>
+
+#include "test-harness.h"
+
+using namespace vm;
+
+namespace {
+
+// objects in this test consist of a header pointing to ObjectType, the
+// number of reference fields, the fields themselves, and a payload
+// word used to check that nothing was lost or corrupted
+
+uintptr_t ObjectType;
+
+// large objects have the same layout, but a different header and a
+// lot of unused space after the payload
+uintptr_t LargeType;
+
+const unsigned LargeSize = 40 * 1024;
+
+// and objects pointing to LongLivedType are ones we keep forever
+uintptr_t LongLivedType;
+
+const unsigned FieldCount = 2;
+const unsigned ObjectSize = FieldCount + 3;
+
+void*& field(void* o, unsigned i)
+{
+  return static_cast<void**>(o)[i + 2];
+}
+
+uintptr_t& payload(void* o)
+{
+  return static_cast<uintptr_t*>(o)[FieldCount + 2];
+}
+
+class Client : public Heap::Client {
+ public:
+  Client(Heap* heap, void** roots, unsigned rootCount)
+      : heap(heap), roots(roots), rootCount(rootCount)
+  {
+  }
+
+  virtual void collect(void*, Heap::CollectionType)
+  {
+  }
+
+  virtual void visitRoots(Heap::Visitor* v)
+  {
+    for (unsigned i = 0; i < rootCount; ++i) {
+      v->visit(roots + i);
+    }
+
+    heap->postVisit();
+  }
+
+  virtual bool isFixed(void* p)
+  {
+    return static_cast<uintptr_t*>(p)[0]
+           == reinterpret_cast<uintptr_t>(&LargeType);
+  }
+
+  virtual unsigned sizeInWords(void* p)
+  {
+    return static_cast<uintptr_t*>(heap->follow(p))[1] + 3;
+  }
+
+  virtual unsigned copiedSizeInWords(void* p)
+  {
+    return sizeInWords(p);
+  }
+
+  virtual void copy(void* src, void* dst)
+  {
+    memcpy(dst, heap->follow(src), sizeInWords(src) * BytesPerWord);
+  }
+
+  virtual void walk(void* p, Heap::Walker* w)
+  {
+    uintptr_t* o = static_cast<uintptr_t*>(heap->follow(p));
+    for (unsigned i = 0; i < o[1]; ++i) {
+      if (not w->visit(i + 2)) {
+        break;
+      }
+    }
+  }
+
+  virtual uintptr_t site(void* p)
+  {
+    return static_cast<uintptr_t*>(heap->follow(p))[0];
+  }
+
+  Heap* heap;
+  void** roots;
+  unsigned rootCount;
+};
+
+class Nursery {
+ public:
+  static const unsigned Capacity = 16 * 1024;
+
+  Nursery(Heap* heap) : heap(heap), position(0)
+  {
+    data = static_cast<uintptr_t*>(heap->allocate(Capacity * BytesPerWord));
+  }
+
+  void* make(uintptr_t value, uintptr_t* type = &ObjectType)
+  {
+    if (position + ObjectSize > Capacity) {
+      heap->collect(Heap::MinorCollection, position, 0);
+      position = 0;
+    }
+
+    uintptr_t* o = data + position;
+    position += ObjectSize;
+
+    o[0] = reinterpret_cast<uintptr_t>(type);
+    o[1] = FieldCount;
+    for (unsigned i = 0; i < FieldCount; ++i) {
+      field(o, i) = 0;
+    }
+    payload(o) = value;
+
+    return o;
+  }
+
+  void dispose()
+  {
+    heap->free(data, Capacity * BytesPerWord);
+  }
+
+  Heap* heap;
+  uintptr_t* data;
+  unsigned position;
+};
+
+// sets *zeroed to whether the object was all zeroes before we
+// initialized it, as it should be even when reusing a freed block
+void* makeLarge(Heap* heap, uintptr_t value, bool* zeroed)
+{
+  uintptr_t* o = static_cast<uintptr_t*>(heap->allocateLarge(LargeSize, false));
+
+  *zeroed = true;
+  for (unsigned i = 0; i < LargeSize; ++i) {
+    if (o[i]) {
+      *zeroed = false;
+    }
+  }
+
+  o[0] = reinterpret_cast<uintptr_t>(&LargeType);
+  o[1] = FieldCount;
+  for (unsigned i = 0; i < FieldCount; ++i) {
+    field(o, i) = 0;
+  }
+  payload(o) = value;
+
+  return o;
+}
+
+uintptr_t value(unsigned list, unsigned generation, unsigned index)
+{
+  return (list * 1000003) + (generation * 7919) + index;
+}
+
+// builds many linked lists which live long enough to be tenured, then
+// replaces them at random while linking old lists to newer ones, so
+// that gen2 fills with garbage and objects referenced only from gen2
+bool churn(System* s,
+           unsigned pauseBudget,
+           bool compaction,
+           unsigned maximumFree = 0,
+           bool hugePages = false,
+           bool stackTraversal = false)
+{
+  const unsigned ListCount = 1024;
+  const unsigned ListLength = 40;
+  const unsigned Iterations = 20000;
+
+  Heap* heap = makeHeap(s, 256 * 1024 * 1024);
+  heap->setHugePages(hugePages);
+  heap->setPauseBudget(pauseBudget);
+  heap->setCompaction(compaction);
+  heap->setFreeRatio(0, maximumFree);
+  heap->setStackTraversal(stackTraversal);
+
+  void* roots[ListCount];
+  memset(roots, 0, sizeof(roots));
+
+  unsigned generations[ListCount];
+  memset(generations, 0, sizeof(generations));
+
+  // the list whose head the head of each list points to, if any, and
+  // the generation of that head when the link was made
+  unsigned linkedLists[ListCount];
+  unsigned linkedGenerations[ListCount];
+  memset(linkedGenerations, 0, sizeof(linkedGenerations));
+
+  Client client(heap, roots, ListCount);
+  heap->setClient(&client);
+
+  Nursery nursery(heap);
+
+  uint32_t seed = 42;
+  for (unsigned i = 0; i < Iterations; ++i) {
+    seed = (seed * 1103515245) + 12345;
+    unsigned list = (seed >> 8) % ListCount;
+    unsigned generation = ++generations[list];
+
+    roots[list] = 0;
+    for (unsigned j = 0; j < ListLength; ++j) {
+      void* o = nursery.make(value(list, generation, ListLength - j - 1));
+      field(o, 0) = roots[list];
+      roots[list] = o;
+    }
+    linkedGenerations[list] = 0;
+
+    // link an existing list, which may well be tenured by now, to the
+    // new one, using the write barrier as the VM would:
+    seed = (seed * 1103515245) + 12345;
+    unsigned other = (seed >> 8) % ListCount;
+    if (other != list and roots[other]) {
+      void* head = heap->follow(roots[other]);
+      field(head, 1) = roots[list];
+      heap->mark(head, 3, 1);
+
+      linkedLists[other] = list;
+      linkedGenerations[other] = generation;
+    }
+  }
+
+  heap->collect(Heap::MinorCollection, nursery.position, 0);
+  nursery.position = 0;
+
+  bool success = true;
+  for (unsigned i = 0; i < ListCount; ++i) {
+    unsigned j = 0;
+    for (void* o = roots[i]; o; o = field(o, 0)) {
+      success = success and payload(o) == value(i, generations[i], j++);
+    }
+    success = success and j == (generations[i] ? ListLength : 0);
+
+    if (linkedGenerations[i]) {
+      void* o = field(roots[i], 1);
+      success = success and o
+                and payload(o)
+                    == value(linkedLists[i], linkedGenerations[i], 0);
+    }
+  }
+
+  nursery.dispose();
+  heap->dispose();
+
+  return success;
+}
+
+class CopyCounter : public Client {
+ public:
+  CopyCounter(Heap* heap, void** roots, unsigned rootCount)
+      : Client(heap, roots, rootCount), longLivedCopies(0)
+  {
+  }
+
+  virtual void copy(void* src, void* dst)
+  {
+    if (site(src) == reinterpret_cast<uintptr_t>(&LongLivedType)) {
+      ++longLivedCopies;
+    }
+
+    Client::copy(src, dst);
+  }
+
+  unsigned longLivedCopies;
+};
+
+// allocates a chain of objects we keep forever amid plenty of
+// garbage, returning how many times the former were copied, or zero
+// if any were lost or corrupted
+unsigned longLivedCopies(System* s, bool pretenuring)
+{
+  const unsigned Iterations = 200000;
+  const unsigned LongLivedInterval = 8;
+
+  Heap* heap = makeHeap(s, 64 * 1024 * 1024);
+  heap->setPretenuring(pretenuring);
+
+  void* root = 0;
+  CopyCounter client(heap, &root, 1);
+  heap->setClient(&client);
+
+  Nursery nursery(heap);
+
+  for (unsigned i = 0; i < Iterations; ++i) {
+    if (i % LongLivedInterval == 0) {
+      void* o = nursery.make(i, &LongLivedType);
+      field(o, 0) = root;
+      root = o;
+    } else {
+      nursery.make(i);
+    }
+  }
+
+  heap->collect(Heap::MinorCollection, nursery.position, 0);
+  nursery.position = 0;
+
+  unsigned copies = client.longLivedCopies;
+
+  unsigned i = Iterations;
+  for (void* o = root; o; o = field(o, 0)) {
+    do {
+      --i;
+    } while (i % LongLivedInterval);
+
+    if (payload(o) != i) {
+      copies = 0;
+    }
+  }
+
+  if (i) {
+    copies = 0;
+  }
+
+  nursery.dispose();
+  heap->dispose();
+
+  return copies;
+}
+
+}  // namespace
+
+TEST(Heap)
+{
+  System* s = makeSystem();
+
+  // a small heap shouldn't let the client reserve most of it as eden
+  {
+    Heap* heap = makeHeap(s, 1024 * 1024);
+    assertTrue(heap->incomingLimit() <= 128 * 1024);
+    heap->dispose();
+  }
+
+  assertTrue(churn(s, 0, false));
+
+  // with a pause budget, gen2 is marked and swept incrementally
+  assertTrue(churn(s, 1, false));
+
+  // with compaction, major collections mark gen2 in place and
+  // evacuate objects from the top of it, and here we also give free
+  // gen2 pages back to the OS as soon as we can
+  assertTrue(churn(s, 0, true, 50));
+
+  // segments may be backed by huge pages, if the system has any
+  assertTrue(churn(s, 0, false, 0, true));
+
+  // the graph may be traversed with an explicit stack instead of by
+  // pointer reversal, including while marking gen2 incrementally and
+  // evacuating it in place
+  assertTrue(churn(s, 0, false, 0, false, true));
+  assertTrue(churn(s, 1, true, 50, false, true));
+
+  s->dispose();
+}
+
+TEST(LargeObjects)
+{
+  System* s = makeSystem();
+  Heap* heap = makeHeap(s, 64 * 1024 * 1024);
+
+  const unsigned LiveCount = 4;
+
+  void* roots[LiveCount + 1];
+  memset(roots, 0, sizeof(roots));
+
+  Client client(heap, roots, LiveCount + 1);
+  heap->setClient(&client);
+
+  bool zeroed;
+  for (unsigned i = 0; i < LiveCount; ++i) {
+    roots[i] = makeLarge(heap, i, &zeroed);
+    assertTrue(zeroed);
+  }
+
+  // allocate many more transient objects than could be live at once,
+  // which should be reclaimed without disturbing the others
+  for (unsigned i = 0; i < 200; ++i) {
+    roots[LiveCount] = makeLarge(heap, LiveCount + i, &zeroed);
+    assertTrue(zeroed);
+    if (i % 10 == 9) {
+      heap->collect(Heap::MinorCollection, 0, 0);
+    }
+  }
+
+  roots[LiveCount] = 0;
+  heap->collect(Heap::MinorCollection, 0, 0);
+
+  for (unsigned i = 0; i < LiveCount; ++i) {
+    assertEqual<uint64_t>(i, payload(roots[i]));
+  }
+
+  assertTrue(heap->largeFootprint() >= LiveCount * LargeSize * BytesPerWord);
+  assertTrue(heap->largeFootprint()
+             < (LiveCount + 1) * LargeSize * BytesPerWord);
+
+  heap->disposeFixies();
+  heap->dispose();
+  s->dispose();
+}
+
+TEST(Pretenuring)
+{
+  System* s = makeSystem();
+
+  unsigned normal = longLivedCopies(s, false);
+  unsigned pretenured = longLivedCopies(s, true);
+
+  assertTrue(normal > 0);
+  assertTrue(pretenured > 0);
+
+  // objects we keep forever should mostly be copied straight to gen2
+  // once their site has been sampled, rather than aging in gen1 first
+  assertTrue(pretenured * 2 < normal);
+
+  s->dispose();
+}
@@ -0,0 +1,110 @@
+/* Copyright (c) 2008-2015, Avian Contributors
+
+   Permission to use, copy, modify, and/or distribute this software
+   for any purpose with or without fee is hereby granted, provided
+   that the above copyright notice and this permission notice appear
+   in all copies.
+
+   There is NO WARRANTY for this software.  See license.txt for
+   details. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "avian/common.h"
+#include <avian/heap/heap.h>
+#include <avian/system/system.h>
+
+#include "avian/lz4.h"
+
+#include "test-harness.h"
+
+using namespace vm;
+
+class RoundTrip {
+ public:
+  RoundTrip(System* s, Heap* heap, const uint8_t* data, size_t size)
+      : heap(heap), encodedSize(0), decodedSize(0)
+  {
+    encoded = encodeLZ4(heap, data, size, &encodedSize);
+    decoded = decodeLZ4(s, heap, encoded, encodedSize, &decodedSize);
+  }
+
+  ~RoundTrip()
+  {
+    heap->free(encoded, encodedSize);
+    heap->free(decoded, decodedSize);
+  }
+
+  Heap* heap;
+  uint8_t* encoded;
+  size_t encodedSize;
+  uint8_t* decoded;
+  size_t decodedSize;
+};
+
+TEST(LZ4)
+{
+  System* s = makeSystem();
+  Heap* heap = makeHeap(s, 32 * 1024 * 1024);
+
+  const size_t size = (LZ4BlockSize * 3) + 12345;
+  uint8_t* data = static_cast<uint8_t*>(heap->allocate(size));
+
+  // empty input
+  {
+    RoundTrip r(s, heap, data, 0);
+    assertEqual<uint64_t>(0, r.decodedSize);
+  }
+
+  // input too short to contain a match
+  {
+    memcpy(data, "hello", 5);
+    RoundTrip r(s, heap, data, 5);
+    assertEqual<uint64_t>(5, r.decodedSize);
+    assertTrue(memcmp(data, r.decoded, 5) == 0);
+  }
+
+  // compressible input spanning several blocks, including runs,
+  // long literals, and long matches
+  for (size_t i = 0; i < size; ++i) {
+    if ((i / 1000) % 3 == 0) {
+      data[i] = 'a';
+    } else if ((i / 1000) % 3 == 1) {
+      data[i] = (i * 7) ^ (i >> 5);
+    } else {
+      data[i] = "the quick brown fox jumps over the lazy dog"[i % 43];
+    }
+  }
+
+  {
+    RoundTrip r(s, heap, data, size);
+    assertTrue(r.encodedSize < size / 2);
+    assertEqual<uint64_t>(size, r.decodedSize);
+    assertTrue(memcmp(data, r.decoded, size) == 0);
+
+    // the frame header is little-endian regardless of the host
+    for (unsigned i = 0; i < 4; ++i) {
+      assertEqual<uint64_t>((size >> (i * 8)) & 0xFF, r.encoded[i]);
+    }
+  }
+
+  // incompressible input, which is stored as is
+  uint32_t seed = 42;
+  for (size_t i = 0; i < size; ++i) {
+    seed = (seed * 1103515245) + 12345;
+    data[i] = seed >> 16;
+  }
+
+  {
+    RoundTrip r(s, heap, data, size);
+    assertTrue(r.encodedSize < size + 64);
+    assertEqual<uint64_t>(size, r.decodedSize);
+    assertTrue(memcmp(data, r.decoded, size) == 0);
+  }
+
+  heap->free(data, size);
+
+  heap->dispose();
+  s->dispose();
+}